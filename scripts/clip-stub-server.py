@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+
+#
+# Minimal stand-in for the CLIP text-to-vector service (for local testing).
+#
+#   GET /clip-embedding/<text>  -> `dim` float32 values (the normalized text embedding)
+#   GET /clip-results/<text>    -> N int32 frame IDs followed by N float32 similarities
+#                                  (requires `--features`)
+#
+# The embeddings are pseudo-random but deterministic for each text, so the
+# same query always gives the same ranking.
+#
+
+import argparse
+import hashlib
+import struct
+import sys
+import urllib.parse
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+
+parser = argparse.ArgumentParser(description='Serves fake CLIP text embeddings.')
+parser.add_argument('--port', type=int, default=8083, help='Port to listen on.')
+parser.add_argument('--dim', type=int, default=768, help='Dimension of the embeddings.')
+parser.add_argument('--features', type=str, default=None,
+                    help='Raw float32 row-major matrix of the frame features (for the /clip-results endpoint).')
+parser.add_argument('--features-offset', type=int, default=0, help='Byte offset of the data in the features file.')
+args = parser.parse_args()
+
+
+def text_embedding(text, dim):
+    seed = hashlib.sha256(text.strip().lower().encode('utf-8')).digest()
+    vals = []
+    counter = 0
+    while len(vals) < dim:
+        block = hashlib.sha256(seed + counter.to_bytes(4, 'little')).digest()
+        vals.extend((b - 127.5) / 127.5 for b in block)
+        counter += 1
+    vals = vals[:dim]
+
+    length = sum(v * v for v in vals) ** 0.5
+    return [v / length for v in vals]
+
+
+def load_features(filepath, offset, dim):
+    with open(filepath, 'rb') as f:
+        f.seek(offset)
+        data = f.read()
+
+    row_len = dim * 4
+    num_rows = len(data) // row_len
+    return [struct.unpack_from('<%df' % dim, data, i * row_len) for i in range(num_rows)]
+
+
+features = load_features(args.features, args.features_offset, args.dim) if args.features else None
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+
+    def reply(self, code, body):
+        self.send_response(code)
+        self.send_header('Content-Type', 'application/octet-stream')
+        self.send_header('Content-Length', str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def do_GET(self):
+        parts = self.path.split('?')[0].strip('/').split('/', 1)
+        if len(parts) != 2:
+            return self.reply(404, b'')
+
+        endpoint, text = parts[0], urllib.parse.unquote(parts[1])
+        emb = text_embedding(text, args.dim)
+
+        if endpoint == 'clip-embedding':
+            return self.reply(200, struct.pack('<%df' % args.dim, *emb))
+
+        if endpoint == 'clip-results':
+            if features is None:
+                return self.reply(501, b'')
+
+            sims = [sum(a * b for a, b in zip(emb, fv)) for fv in features]
+            ids = list(range(len(features)))
+            return self.reply(200, struct.pack('<%di' % len(ids), *ids) + struct.pack('<%df' % len(sims), *sims))
+
+        return self.reply(404, b'')
+
+    def log_message(self, format, *a):
+        sys.stderr.write('CLIP stub: ' + (format % a) + '\n')
+
+
+print('CLIP stub listening on port %d (dim %d)...' % (args.port, args.dim))
+ThreadingHTTPServer(('', args.port), Handler).serve_forever()
@@ -0,0 +1,194 @@
+#!/usr/bin/env python3
+
+#
+# Exports int8 quantized versions of the canvas query CNNs (ResNet152 & ResNeXt101)
+# and compares their features to the FP32 ones.
+#
+#   static  - post-training static quantization of the traced models (convolutions
+#             included), calibrated on frames of the dataset
+#   dynamic - dynamic quantization (only the linear layers, small gain for CNNs)
+#
+# The features are computed exactly as `CanvasQueryRanker` does (both CNNs, the W2VV FC
+# layer, PCA) and compared to the FP32 features and to the whole-frame features of the
+# first collage region file (`<collage_region_file_prefix>0.bin`).
+#
+# Usage:
+#   python3 scripts/quantize-canvas-models.py config/config-core.json
+#   python3 scripts/quantize-canvas-models.py config/config-core.json --eval-only
+#
+# Then set `"use_int8_models": true` in the config. The models are packed for the
+# `--backend` engine, the core must run on a CPU supporting it (fbgemm: x86, qnnpack: ARM).
+#
+
+import argparse
+import json
+import os
+import random
+import sys
+import time
+
+import numpy as np
+import torch
+from PIL import Image
+
+parser = argparse.ArgumentParser(description='Quantizes the canvas query models to int8.')
+parser.add_argument('config_core_file', type=str, help='Filepath of the config JSON.')
+parser.add_argument('--mode', type=str, default='static', choices=['static', 'dynamic'],
+                    help='Quantization mode.')
+parser.add_argument('--backend', type=str, default='fbgemm', choices=['fbgemm', 'qnnpack'],
+                    help='Quantized engine the models are packed for.')
+parser.add_argument('--calib-frames', type=int, default=512, help='Number of frames for the calibration.')
+parser.add_argument('--eval-frames', type=int, default=1000, help='Number of frames for the comparison.')
+parser.add_argument('--batch-size', type=int, default=32, help='Inference batch size.')
+parser.add_argument('--seed', type=int, default=42, help='Seed of the frame sampling.')
+parser.add_argument('--eval-only', action='store_true', help='Only compare the already exported int8 models.')
+args = parser.parse_args()
+
+# The same as in `CanvasQueryRanker::encode_bitmaps`
+INPUT_SIZE = 224
+RESNEXT_MEANS = np.array([123.68, 116.779, 103.939], dtype=np.float32)
+
+
+def load_config(filepath):
+    try:
+        with open(filepath, 'r') as ifs:
+            return json.load(ifs)["core"]
+    except OSError:
+        print("Could not open/read file: {}".format(filepath))
+        sys.exit(1)
+
+
+def load_floats(filepath, count=None):
+    data = np.fromfile(filepath, dtype=np.float32)
+    if count is not None and data.size < count:
+        print("File '{}' has {} floats, expected {}.".format(filepath, data.size, count))
+        sys.exit(1)
+    return data if count is None else data[:count]
+
+
+def load_frame(filepath):
+    img = Image.open(filepath).convert('RGB').resize((INPUT_SIZE, INPUT_SIZE), Image.BILINEAR)
+    img = np.asarray(img, dtype=np.float32)
+    # (plain for ResNet, mean-subtracted for ResNeXt) in CHW
+    return img.transpose(2, 0, 1).copy(), (img - RESNEXT_MEANS).transpose(2, 0, 1).copy()
+
+
+def load_batches(frame_files, frame_IDs, batch_size):
+    batches = []
+    for i in range(0, len(frame_IDs), batch_size):
+        imgs = [load_frame(frame_files[ID]) for ID in frame_IDs[i:i + batch_size]]
+        batches.append((torch.from_numpy(np.stack([x for x, _ in imgs])),
+                        torch.from_numpy(np.stack([x for _, x in imgs]))))
+    return batches
+
+
+class W2VVHead:
+    """ The FC layer and PCA applied on top of the CNN features (as in `CanvasQueryRanker::bitmap_features`). """
+
+    def __init__(self, models, features):
+        pre_dim = features["pre_PCA_features_dim"]
+        pca_dim = features["kw_PCA_mat_dim"]
+
+        self.bias = torch.from_numpy(load_floats(models["model_W2VV_img_bias"], 2048))
+        self.weights = torch.from_numpy(load_floats(models["model_W2VV_img_weigths"], 4096 * 2048)).reshape(
+            2048, 4096).t()
+        self.pca_mat = torch.from_numpy(load_floats(features["kw_PCA_mat_file"], pre_dim * pca_dim)).reshape(
+            pca_dim, pre_dim).t()
+        self.pca_mean = torch.from_numpy(load_floats(features["kw_bias_vec_file"], pre_dim))
+
+    def __call__(self, resnext_features, resnet_features):
+        x = torch.cat([resnext_features, resnet_features], 1).float()
+        x = torch.tanh(x @ self.weights + self.bias)
+        x = x / x.norm(dim=1, keepdim=True)
+        x = (x - self.pca_mean) @ self.pca_mat
+        return x / x.norm(dim=1, keepdim=True)
+
+
+def quantize(model, batches, input_idx):
+    from torch.ao.quantization import (default_dynamic_qconfig, get_default_qconfig, quantize_dynamic_jit,
+                                       quantize_jit)
+
+    if args.mode == 'dynamic':
+        return quantize_dynamic_jit(model, {'': default_dynamic_qconfig})
+
+    def calibrate(m, data):
+        with torch.no_grad():
+            for batch in data:
+                m(batch[input_idx])
+
+    return quantize_jit(model, {'': get_default_qconfig(args.backend)}, calibrate, [batches])
+
+
+def encode(resnet, resnext, head, batches):
+    feats = []
+    start = time.perf_counter()
+    with torch.no_grad():
+        for batch, batch_norm in batches:
+            feats.append(head(resnext(batch_norm), resnet(batch)))
+    return torch.cat(feats, 0), time.perf_counter() - start
+
+
+def main():
+    config = load_config(args.config_core_file)
+    models = config["models"]
+    datasets = config["datasets"]
+    features = datasets["primary_features"]
+
+    torch.backends.quantized.engine = args.backend
+
+    with open(datasets["frames_list_file"], 'r') as ifs:
+        frame_files = [os.path.join(datasets["frames_dir"], l.strip()) for l in ifs if l.strip()]
+
+    region_file = features["collage_region_file_prefix"] + "0.bin"
+    region_features = load_floats(region_file).reshape(-1, 128)
+    num_frames = min(len(frame_files), region_features.shape[0])
+
+    rng = random.Random(args.seed)
+    frame_IDs = rng.sample(range(num_frames), min(num_frames, args.calib_frames + args.eval_frames))
+    eval_IDs = frame_IDs[:args.eval_frames]
+    calib_IDs = frame_IDs[args.eval_frames:]
+
+    print(">>> Loading {} evaluation frames...".format(len(eval_IDs)))
+    eval_batches = load_batches(frame_files, eval_IDs, args.batch_size)
+
+    resnet = torch.jit.load(models["model_ResNet_file"]).eval()
+    resnext = torch.jit.load(models["model_ResNext_file"]).eval()
+
+    if not args.eval_only:
+        print(">>> Loading {} calibration frames...".format(len(calib_IDs)))
+        calib_batches = load_batches(frame_files, calib_IDs, args.batch_size) if args.mode == 'static' else []
+
+        for name, model, input_idx, out_file in [
+            ("ResNet152", resnet, 0, models["model_ResNet_int8_file"]),
+            ("ResNeXt101", resnext, 1, models["model_ResNext_int8_file"]),
+        ]:
+            print(">>> Quantizing {} ({}, {})...".format(name, args.mode, args.backend))
+            torch.jit.save(quantize(model, calib_batches, input_idx), out_file)
+            print("Saved '{}'.".format(out_file))
+
+    resnet_int8 = torch.jit.load(models["model_ResNet_int8_file"]).eval()
+    resnext_int8 = torch.jit.load(models["model_ResNext_int8_file"]).eval()
+
+    head = W2VVHead(models, features)
+    fp32, fp32_time = encode(resnet, resnext, head, eval_batches)
+    int8, int8_time = encode(resnet_int8, resnext_int8, head, eval_batches)
+    stored = torch.from_numpy(region_features[eval_IDs].copy())
+    stored = stored / stored.norm(dim=1, keepdim=True)
+
+    def self_retrieval(queries):
+        """ Share of the frames whose own stored feature is the nearest one (among the evaluation frames). """
+        return (queries @ stored.t()).argmax(1).eq(torch.arange(len(eval_IDs))).float().mean().item()
+
+    n = len(eval_IDs)
+    print("\n>>> Comparison on {} frames ({} threads):".format(n, torch.get_num_threads()))
+    print("  time per frame        FP32: {:7.2f} ms    int8: {:7.2f} ms    speed-up: {:.2f}x".format(
+        1000 * fp32_time / n, 1000 * int8_time / n, fp32_time / int8_time))
+    print("  cos(FP32, int8)       mean: {:.4f}    min: {:.4f}".format(
+        (fp32 * int8).sum(1).mean().item(), (fp32 * int8).sum(1).min().item()))
+    print("  cos(x, stored)        FP32: {:.4f}    int8: {:.4f}".format(
+        (fp32 * stored).sum(1).mean().item(), (int8 * stored).sum(1).mean().item()))
+    print("  self-retrieval top-1  FP32: {:.4f}    int8: {:.4f}".format(self_retrieval(fp32), self_retrieval(int8)))
+
+
+if __name__ == '__main__':
+    main()
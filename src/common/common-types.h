@@ -111,6 +111,7 @@ enum class DisplayType {
 	DVideoDetail,
 	DVideoReplay,
 	DRelocation,
+	DSomZoom,
 	NumItems
 };
 
@@ -121,6 +122,7 @@ inline DisplayType str_to_disp_type(const std::string& type_str) {
 	if (type_str == "topn_display") return DisplayType::DTopN;
 	if (type_str == "topn_context_display") return DisplayType::DTopNContext;
 	if (type_str == "SOM_display") return DisplayType::DSom;
+	if (type_str == "SOM_zoom_display") return DisplayType::DSomZoom;
 	if (type_str == "topknn_display") return DisplayType::DTopKNN;
 	if (type_str == "video_detail") return DisplayType::DVideoDetail;
 	if (type_str == "video_replay") return DisplayType::DVideoReplay;
@@ -146,6 +148,10 @@ inline std::string disp_type_to_str(DisplayType type) {
 			disp_type = "SOM_display";
 			break;
 
+		case DisplayType::DSomZoom:
+			disp_type = "SOM_zoom_display";
+			break;
+
 		case DisplayType::DTopKNN:
 			disp_type = "topknn_display";
 			break;
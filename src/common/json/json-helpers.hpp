@@ -63,7 +63,7 @@ inline void require_key(const json& json, const std::string& key) {
  */
 template <typename T_>
 inline T_ optional_value_or(const json& j, const std::string& key, const T_& or_val) {
-	if (j[key].is_null()) {
+	if (!j.contains(key) || j[key].is_null()) {
 		return or_val;
 	} else {
 		return j[key].get<T_>();
@@ -78,7 +78,7 @@ inline T_ optional_value_or(const json& j, const std::string& key, const T_& or_
  */
 template <>
 inline std::string optional_value_or(const json& j, const std::string& key, const std::string& or_val) {
-	if (j[key].is_null() || j[key].get<std::string>().empty()) {
+	if (!j.contains(key) || j[key].is_null() || j[key].get<std::string>().empty()) {
 		return or_val;
 	}
 	return j[key].get<std::string>();
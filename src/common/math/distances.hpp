@@ -134,4 +134,57 @@ inline static float d_cos_normalized(const float* p1, const float* p2, const siz
 	return 1.0F - d_dot_normalized(p1, p2, dim);
 }
 
+/**
+ * Computes `out = mat * x` (dot products of `x` with all the rows of the row-major `rows` x `cols` matrix).
+ *
+ * Four rows are processed at once so each load of `x` is shared.
+ */
+inline static void d_dot_rows(const float* mat, size_t rows, size_t cols, const float* x, float* out) {
+	size_t r = 0;
+	for (; r + 4 <= rows; r += 4) {
+		const float* m0 = mat + r * cols;
+		const float* m1 = m0 + cols;
+		const float* m2 = m1 + cols;
+		const float* m3 = m2 + cols;
+
+		size_t c = 0;
+		float s0 = 0.0F, s1 = 0.0F, s2 = 0.0F, s3 = 0.0F;
+#ifdef USE_INTRINS
+		__m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps(), a2 = _mm_setzero_ps(), a3 = _mm_setzero_ps();
+		for (; c + 4 <= cols; c += 4) {
+			__m128 xv = _mm_loadu_ps(x + c);
+			a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(m0 + c), xv));
+			a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(m1 + c), xv));
+			a2 = _mm_add_ps(a2, _mm_mul_ps(_mm_loadu_ps(m2 + c), xv));
+			a3 = _mm_add_ps(a3, _mm_mul_ps(_mm_loadu_ps(m3 + c), xv));
+		}
+		// Horizontal sums of the four accumulators
+		_MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+		float sums[4];
+		_mm_storeu_ps(sums, _mm_add_ps(_mm_add_ps(a0, a1), _mm_add_ps(a2, a3)));
+		s0 = sums[0];
+		s1 = sums[1];
+		s2 = sums[2];
+		s3 = sums[3];
+#endif
+		for (; c < cols; ++c) {
+			s0 += m0[c] * x[c];
+			s1 += m1[c] * x[c];
+			s2 += m2[c] * x[c];
+			s3 += m3[c] * x[c];
+		}
+		out[r] = s0;
+		out[r + 1] = s1;
+		out[r + 2] = s2;
+		out[r + 3] = s3;
+	}
+
+	for (; r < rows; ++r) {
+		const float* m = mat + r * cols;
+		float s = 0.0F;
+		for (size_t c = 0; c < cols; ++c) s += m[c] * x[c];
+		out[r] = s;
+	}
+}
+
 #endif  // DISTANCES_H_
@@ -21,10 +21,13 @@
 
 #include "http.h"
 // ---
+#include <algorithm>
+#include <chrono>
 #include <functional>
+#include <set>
+#include <thread>
 // ---
 #include <curl/curl.h>
-#include <regex>
 
 using namespace sh;
 
@@ -108,169 +111,415 @@ static int trace_fn(CURL* handle, curl_infotype type, char* dt, size_t size, voi
 
 #endif  // DEBUG_CURL_REQUESTS
 
-static size_t res_cb(char* contents, size_t size, size_t nmemb, void* userp) {
-	static_cast<std::string*>(userp)->append(contents, size * nmemb);
-	return size * nmemb;
+void HttpLatencyHistogram::add(double ms, bool ok) {
+	size_t bucket{ 0 };
+	while (bucket < BUCKET_BOUNDS_MS.size() && ms > BUCKET_BOUNDS_MS[bucket]) ++bucket;
+
+	++counts[bucket];
+	++num_requests;
+	if (!ok) ++num_failed;
+	total_ms += ms;
+	max_ms = std::max(max_ms, ms);
 }
 
-static void request_worker(RequestType type, const std::string& submit_URL, const nlohmann::json& body,
-                           const nlohmann::json& /*headers*/ = {},
-                           std::function<void(ReqCode, std::vector<uint8_t>&&)> cb_succ = {},
-                           std::function<void()> cb_err = {}, const std::string& cookie_filepath = "",
-                           bool allow_insecure = false) {
-	CURL* curl = curl_easy_init();
-	// std::string res_buffer;
+double HttpLatencyHistogram::percentile(double p) const {
+	if (num_requests == 0) return 0.0;
 
-	std::string url = std::regex_replace(submit_URL, std::regex("\\s"), "%20");
-	static std::string hdr = "Content-type: application/json";
-	static struct curl_slist reqheader = { hdr.data(), nullptr };
-	auto data_serialized{ body.dump() };
+	const size_t rank{ size_t(std::ceil(p * num_requests)) };
+	size_t acc{ 0 };
+	for (size_t i = 0; i < BUCKET_BOUNDS_MS.size(); ++i) {
+		acc += counts[i];
+		if (acc >= rank) return double(BUCKET_BOUNDS_MS[i]);
+	}
+	return max_ms;
+}
 
-	// POST/GET
-	switch (type) {
-		case RequestType::GET:
-			// Check
-			do_assert(body.is_object() || body.is_null(), "Query is either null or dictionary.");
+/** Replaces all the whitespace characters with "%20". */
+static std::string escape_whitespace(const std::string& URL) {
+	std::string res;
+	res.reserve(URL.size());
+	for (char c : URL) {
+		if (std::isspace(static_cast<unsigned char>(c)))
+			res.append("%20");
+		else
+			res.push_back(c);
+	}
+	return res;
+}
 
-			// ***
-			// Build the query
+/** Builds the final URL (the GET query appended). */
+static std::string build_URL(RequestType type, const std::string& submit_URL, const nlohmann::json& body) {
+	std::string url{ escape_whitespace(submit_URL) };
+	if (type != RequestType::GET) return url;
 
-			// '?' character
-			if (!body.is_null() && !body.empty()) {
-				url.append("?");
-			}
+	// Check
+	do_assert(body.is_object() || body.is_null(), "Query is either null or dictionary.");
 
-			// Data
-			for (auto& el : body.items()) {
-				std::string s;
-				if (el.value().is_string()) {
-					s.append(el.key()).append("=").append(el.value()).append("&");
-				} else {
-					std::stringstream ss;
-					ss << el.key() << "=" << el.value() << "&";
-					s = ss.str();
-				}
-
-				url.append(s);
-			}
+	// '?' character
+	if (!body.is_null() && !body.empty()) {
+		url.append("?");
+	}
 
-			if (!body.is_null()) {
-				url.pop_back();
-			}
+	// Data
+	for (auto& el : body.items()) {
+		std::string s;
+		if (el.value().is_string()) {
+			s.append(el.key()).append("=").append(el.value()).append("&");
+		} else {
+			std::stringstream ss;
+			ss << el.key() << "=" << el.value() << "&";
+			s = ss.str();
+		}
 
-			curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "GET");
-			break;
+		url.append(s);
+	}
 
-		case RequestType::POST:
-			curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "POST");
-			curl_easy_setopt(curl, CURLOPT_POSTFIELDS, data_serialized.c_str());
-			curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, data_serialized.length());
-			break;
+	if (!body.is_null() && !body.empty()) {
+		url.pop_back();
+	}
+	return url;
+}
+
+namespace {
+
+/** One request being processed by the `HttpEngine`. */
+struct Transfer {
+	using Clock = std::chrono::steady_clock;
+
+	RequestType type;
+	std::string URL;
+	/** The URL without the query, the histograms are kept for it. */
+	std::string endpoint;
+	std::string post_data;
+	bool allow_insecure;
+
+	std::vector<uint8_t> res_body;
+	std::function<void(HttpResponse&&)> done;
+	Clock::time_point started;
+};
+
+/**
+ * The process-wide cURL multi handle and its I/O thread.
+ *
+ * The easy handles are recycled (`curl_easy_reset` keeps their connection
+ * and DNS caches), the connections are kept alive in the multi handle's pool.
+ */
+class HttpEngine {
+public:
+	static HttpEngine& instance() {
+		static HttpEngine engine;
+		return engine;
 	}
 
-	// URL
-	curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+	void submit(std::unique_ptr<Transfer> transfer) {
+		{
+			std::lock_guard lck{ _lock };
+			_incoming.emplace_back(std::move(transfer));
+		}
+		curl_multi_wakeup(_multi);
+	}
+
+	std::map<std::string, HttpLatencyHistogram> histograms() const {
+		std::lock_guard lck{ _stats_lock };
+		return _histograms;
+	}
+
+private:
+	/** Maximal number of the connections kept alive to one host. */
+	static constexpr long MAX_HOST_CONNECTIONS = 8;
+	static constexpr size_t MAX_IDLE_HANDLES = 16;
+
+	HttpEngine() {
+		curl_global_init(CURL_GLOBAL_DEFAULT);
+
+		_multi = curl_multi_init();
+		curl_multi_setopt(_multi, CURLMOPT_MAX_HOST_CONNECTIONS, MAX_HOST_CONNECTIONS);
+		curl_multi_setopt(_multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+		// Only the I/O thread uses the handles, no locking needed
+		_share = curl_share_init();
+		curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+		_io_thread = std::thread{ &HttpEngine::io_loop, this };
+	}
+
+	~HttpEngine() noexcept {
+		{
+			std::lock_guard lck{ _lock };
+			_terminate = true;
+		}
+		curl_multi_wakeup(_multi);
+		_io_thread.join();
+
+		// No logging here, the logger may already be destroyed (see `Http::log_latency_stats`)
+		for (auto&& easy : _idle) curl_easy_cleanup(easy);
+		curl_multi_cleanup(_multi);
+		curl_share_cleanup(_share);
+	}
+
+	static size_t write_cb(char* contents, size_t size, size_t nmemb, void* userp) {
+		auto& buf{ static_cast<Transfer*>(userp)->res_body };
+		buf.insert(buf.end(), contents, contents + size * nmemb);
+		return size * nmemb;
+	}
+
+	CURL* acquire_easy() {
+		if (_idle.empty()) return curl_easy_init();
+
+		CURL* easy{ _idle.back() };
+		_idle.pop_back();
+		curl_easy_reset(easy);
+		return easy;
+	}
+
+	void release_easy(CURL* easy) {
+		if (_idle.size() < MAX_IDLE_HANDLES)
+			_idle.push_back(easy);
+		else
+			curl_easy_cleanup(easy);
+	}
+
+	void start(Transfer* t) {
+		static std::string hdr = "Content-type: application/json";
+		static struct curl_slist reqheader = { hdr.data(), nullptr };
+
+		CURL* curl{ acquire_easy() };
+		if (curl == nullptr) {
+			fail(std::unique_ptr<Transfer>{ t }, "Failed to create the cURL handle.");
+			return;
+		}
+
+		// POST/GET
+		switch (t->type) {
+			case RequestType::GET:
+				curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+				break;
+
+			case RequestType::POST:
+				curl_easy_setopt(curl, CURLOPT_POST, 1L);
+				curl_easy_setopt(curl, CURLOPT_POSTFIELDS, t->post_data.c_str());
+				curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, long(t->post_data.length()));
+				break;
+		}
+
+		// URL
+		curl_easy_setopt(curl, CURLOPT_URL, t->URL.c_str());
 
 // Verbose CURL debug print
 #if DEBUG_CURL_REQUESTS
-	curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, trace_fn);
-	curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
+		curl_easy_setopt(curl, CURLOPT_DEBUGFUNCTION, trace_fn);
+		curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
 #endif  // DEBUG_CURL_REQUESTS
 
-	// Insecurity
-	if (allow_insecure) {
-		// SHLOG_W("Doing insecure connection!");
-		// Add `--insecure` option
-		curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
+		// Insecurity
+		if (t->allow_insecure) {
+			// Add `--insecure` option
+			curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+		}
+
+		curl_easy_setopt(curl, CURLOPT_SHARE, _share);
+		curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+
+		curl_easy_setopt(curl, CURLOPT_HEADER, 0L);
+		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_cb);
+		curl_easy_setopt(curl, CURLOPT_WRITEDATA, static_cast<void*>(t));
+		curl_easy_setopt(curl, CURLOPT_PRIVATE, static_cast<void*>(t));
+
+		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, &reqheader);
+
+		curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 30L);
+		// Add `-L` option
+		curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+		// Add `--post301 --post302 --post303` option
+		curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
+
+		t->started = Transfer::Clock::now();
+		if (CURLMcode res = curl_multi_add_handle(_multi, curl); res != CURLM_OK) {
+			curl_easy_cleanup(curl);
+			fail(std::unique_ptr<Transfer>{ t }, curl_multi_strerror(res));
+			return;
+		}
+		_active.insert(curl);
 	}
 
-	// Cookies
-	if (!cookie_filepath.empty()) {
-		curl_easy_setopt(curl, CURLOPT_COOKIEFILE, cookie_filepath.c_str());
-		curl_easy_setopt(curl, CURLOPT_COOKIEJAR, cookie_filepath.c_str());
+	/** Completes the transfer that could not be started. */
+	void fail(std::unique_ptr<Transfer> t, const std::string& error) {
+		{
+			std::lock_guard lck{ _stats_lock };
+			_histograms[t->endpoint].add(0.0, false);
+		}
+
+		SHLOG_E("HTTP request '" << t->URL << "' failed: " << error);
+		if (t->done) t->done(HttpResponse{ false, ReqCode(0), {}, error });
 	}
-	curl_easy_setopt(curl, CURLOPT_HEADER, 0);
-	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, res_cb);
 
-	std::string str_buffer;
-	curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void*)&str_buffer);
+	void finish(CURL* curl, CURLcode res) {
+		Transfer* p_t{ nullptr };
+		curl_easy_getinfo(curl, CURLINFO_PRIVATE, reinterpret_cast<char**>(&p_t));
+		std::unique_ptr<Transfer> t{ p_t };
 
-	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, &reqheader);
+		long res_code{ 0 };
+		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &res_code);
 
-	curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 30);
-	// Add `-L` option
-	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1);
-	// Add `--post301 --post302 --post303` option
-	curl_easy_setopt(curl, CURLOPT_POSTREDIR, CURL_REDIR_POST_ALL);
+		curl_multi_remove_handle(_multi, curl);
+		_active.erase(curl);
+		release_easy(curl);
 
-	// >>>
-	auto res{ curl_easy_perform(curl) };
-	// >>>
+		const double ms{ std::chrono::duration<double, std::milli>(Transfer::Clock::now() - t->started).count() };
+		{
+			std::lock_guard lck{ _stats_lock };
+			_histograms[t->endpoint].add(ms, res == CURLE_OK);
+		}
+
+		HttpResponse response{ res == CURLE_OK, ReqCode(res_code), std::move(t->res_body), "" };
+		if (res == CURLE_OK) {
+			SHLOG_D("HTTP request OK: '" << t->URL << "' (" << ms << " ms)");
+		} else {
+			response.error = curl_easy_strerror(res);
+			SHLOG_E("HTTP request failed with cURL error: " << response.error);
+		}
+
+		if (t->done) t->done(std::move(response));
+	}
+
+	void io_loop() {
+		while (true) {
+			std::vector<std::unique_ptr<Transfer>> incoming;
+			bool terminate;
+			{
+				std::lock_guard lck{ _lock };
+				incoming.swap(_incoming);
+				terminate = _terminate;
+			}
 
-	long res_code;
-	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &res_code);
+			for (auto&& t : incoming) start(t.release());
+			if (terminate && _active.empty()) return;
 
-	if (res == CURLE_OK) {
-		SHLOG_D("HTTP request OK: '" << url << "'");
-		std::vector<uint8_t> res_buffer(str_buffer.begin(), str_buffer.end());
+			int num_running{ 0 };
+			curl_multi_perform(_multi, &num_running);
 
-		// Call the success
-		cb_succ(static_cast<ReqCode>(res_code), std::move(res_buffer));
-	} else {
-		SHLOG_E("POST request failed with cURL error: " << curl_easy_strerror(res));
+			int num_left{ 0 };
+			while (CURLMsg* msg = curl_multi_info_read(_multi, &num_left)) {
+				if (msg->msg == CURLMSG_DONE) finish(msg->easy_handle, msg->data.result);
+			}
 
-		// Call the success
-		cb_err();
+			// Sleep until some socket is ready, a new request comes or cURL's timer expires
+			long timeout_ms{ -1 };
+			curl_multi_timeout(_multi, &timeout_ms);
+			if (timeout_ms < 0 || timeout_ms > 1000) timeout_ms = 1000;
+			if (!_active.empty() || !terminate) curl_multi_poll(_multi, nullptr, 0, int(timeout_ms), nullptr);
+		}
 	}
 
-	curl_easy_cleanup(curl);
-}
+	CURLM* _multi;
+	CURLSH* _share;
+
+	std::mutex _lock;
+	std::vector<std::unique_ptr<Transfer>> _incoming;
+	bool _terminate{ false };
+
+	// Only for the I/O thread
+	std::set<CURL*> _active;
+	std::vector<CURL*> _idle;
 
-Http::~Http() {
-	for (auto& t : submit_threads) t.join();
+	mutable std::mutex _stats_lock;
+	std::map<std::string, HttpLatencyHistogram> _histograms;
+
+	std::thread _io_thread;
+};
+
+}  // namespace
+
+Http::~Http() noexcept {
+	std::unique_lock lck{ _pending->lock };
+	_pending->finished.wait(lck, [this]() { return _pending->count == 0; });
 }
 
-void Http::do_POST_async(const std::string& URL, const nlohmann::json& body, const nlohmann::json& /*headers*/,
-                         std::function<void(ReqCode, nlohmann::json)> cb_succ, std::function<void()> cb_err) {
-	finish_flags.emplace_back(std::make_unique<bool>(false));
+void Http::do_request_async(const RequestType request_method, const std::string& URL, const nlohmann::json& body,
+                            const nlohmann::json& /*headers*/, std::function<void(HttpResponse&&)> cb) {
+	auto t{ std::make_unique<Transfer>() };
+	t->type = request_method;
+	t->URL = build_URL(request_method, URL, body);
+	t->endpoint = t->URL.substr(0, t->URL.find('?'));
+	if (request_method == RequestType::POST) t->post_data = body.dump();
+	t->allow_insecure = _allow_insecure;
+
+	{
+		std::lock_guard lck{ _pending->lock };
+		++_pending->count;
+	}
+	t->done = [pending = _pending, cb = std::move(cb)](HttpResponse&& res) {
+		if (cb) cb(std::move(res));
+
+		std::lock_guard lck{ pending->lock };
+		--pending->count;
+		pending->finished.notify_all();
+	};
+
+	HttpEngine::instance().submit(std::move(t));
+}
 
-	submit_threads.emplace_back(request_worker, RequestType::POST, URL, body, nlohmann::json{}, cb_succ, cb_err, "",
-	                            _allow_insecure);
+std::future<HttpResponse> Http::do_request(const RequestType request_method, const std::string& URL,
+                                           const nlohmann::json& body, const nlohmann::json& headers) {
+	auto promise{ std::make_shared<std::promise<HttpResponse>>() };
+	auto res{ promise->get_future() };
 
-	common_finish();
+	do_request_async(request_method, URL, body, headers,
+	                 [promise](HttpResponse&& response) { promise->set_value(std::move(response)); });
+	return res;
 }
 
-void Http::do_GET_async(const std::string& URL, const nlohmann::json& query, const nlohmann::json& /*headers*/,
-                        std::function<void(ReqCode, nlohmann::json)> cb_succ, std::function<void()> cb_err) {
-	finish_flags.emplace_back(std::make_unique<bool>(false));
+/** Calls the JSON callbacks with the result. */
+static void call_json_callbacks(HttpResponse&& res, const std::function<void(ReqCode, nlohmann::json)>& cb_succ,
+                                const std::function<void()>& cb_err) {
+	if (!res.ok) {
+		if (cb_err) cb_err();
+		return;
+	}
 
-	submit_threads.emplace_back(request_worker, RequestType::GET, URL, query, nlohmann::json{}, cb_succ, cb_err, "",
-	                            _allow_insecure);
+	nlohmann::json res_data;
+	try {
+		if (!res.body.empty()) res_data = nlohmann::json::parse(res.body);
+	} catch (const std::exception& e) {
+		SHLOG_E("Invalid JSON response: " << e.what());
+		if (cb_err) cb_err();
+		return;
+	}
 
-	common_finish();
+	if (cb_succ) cb_succ(res.code, std::move(res_data));
 }
 
-std::pair<ReqCode, std::vector<uint8_t>> sh::Http::do_request_sync(const RequestType request_method,
-                                                                   const std::string& URL, const nlohmann::json& body,
-                                                                   const nlohmann::json& /*headers*/) {
-	bool fail{ false };
+void Http::do_POST_async(const std::string& URL, const nlohmann::json& body, const nlohmann::json& headers,
+                         std::function<void(ReqCode, nlohmann::json)> cb_succ, std::function<void()> cb_err) {
+	do_request_async(RequestType::POST, URL, body, headers, [cb_succ, cb_err](HttpResponse&& res) {
+		call_json_callbacks(std::move(res), cb_succ, cb_err);
+	});
+}
 
-	std::vector<uint8_t> res_data;
-	ReqCode res_code;
+void Http::do_GET_async(const std::string& URL, const nlohmann::json& query, const nlohmann::json& headers,
+                        std::function<void(ReqCode, nlohmann::json)> cb_succ, std::function<void()> cb_err) {
+	do_request_async(RequestType::GET, URL, query, headers, [cb_succ, cb_err](HttpResponse&& res) {
+		call_json_callbacks(std::move(res), cb_succ, cb_err);
+	});
+}
 
-	auto succ_fn = [&res_data, &res_code](ReqCode code, std::vector<uint8_t>&& res_buffer) {
-		res_code = code;
-		res_data = std::move(res_buffer);
-	};
+std::map<std::string, HttpLatencyHistogram> Http::latency_histograms() { return HttpEngine::instance().histograms(); }
 
-	auto err_fn = [&fail]() { fail = true; };
+void Http::log_latency_stats() {
+	for (auto&& [endpoint, h] : latency_histograms()) {
+		SHLOG_I("HTTP '" << endpoint << "': " << h.num_requests << " requests (" << h.num_failed << " failed), avg "
+		                 << h.avg_ms() << " ms, p50 <= " << h.percentile(0.5) << " ms, p99 <= " << h.percentile(0.99)
+		                 << " ms, max " << h.max_ms << " ms");
+	}
+}
 
-	std::thread worker{ &request_worker, request_method, URL, body,           nlohmann::json{},
-		                succ_fn,         err_fn,         "",  _allow_insecure };
-	worker.join();  //< Wait for the thread right away
+std::pair<ReqCode, std::vector<uint8_t>> sh::Http::do_request_sync(const RequestType request_method,
+                                                                   const std::string& URL, const nlohmann::json& body,
+                                                                   const nlohmann::json& headers) {
+	auto res{ do_request(request_method, URL, body, headers).get() };
 
-	common_finish();
-	return std::pair<ReqCode, std::vector<uint8_t>>{ res_code, res_data };
+	return std::pair<ReqCode, std::vector<uint8_t>>{ res.code, std::move(res.body) };
 }
 
 std::pair<ReqCode, nlohmann::json> sh::Http::do_POST_sync_json(const std::string& URL, const nlohmann::json& body,
@@ -22,9 +22,14 @@
 #ifndef HTTP_H_
 #define HTTP_H_
 
+#include <array>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
-#include <thread>
 #include <vector>
 // ---
 #include <nlohmann/json.hpp>
@@ -35,11 +40,64 @@ namespace sh {
 using ReqCode = std::size_t;
 enum class RequestType { GET, POST };
 
+/** Result of one HTTP request. */
+struct HttpResponse {
+	/** False if the request failed on the transport level (`code` is 0 then). */
+	bool ok;
+	ReqCode code;
+	std::vector<uint8_t> body;
+	std::string error;
+};
+
+/** Latency histogram of the requests to one endpoint. */
+struct HttpLatencyHistogram {
+	/** Upper bounds of the buckets in milliseconds, the last bucket is unbounded. */
+	static constexpr std::array<size_t, 12> BUCKET_BOUNDS_MS{ 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000 };
+
+	std::array<size_t, BUCKET_BOUNDS_MS.size() + 1> counts{};
+	size_t num_requests{ 0 };
+	size_t num_failed{ 0 };
+	double total_ms{ 0.0 };
+	double max_ms{ 0.0 };
+
+	void add(double ms, bool ok);
+
+	double avg_ms() const { return num_requests == 0 ? 0.0 : total_ms / num_requests; }
+
+	/** Approximate percentile `p` \in [0, 1] (the upper bound of its bucket). */
+	double percentile(double p) const;
+};
+
+/**
+ * HTTP client.
+ *
+ * All the clients of the process share one cURL multi handle driven by one
+ * I/O thread. The connections are kept alive and pooled per host, the DNS
+ * cache and the TLS sessions are shared, so the repeated requests to the same
+ * service do not pay for the new handshakes.
+ *
+ * The callbacks are called from the I/O thread and must not block on other
+ * requests.
+ */
 class Http {
 	// *** METHODS ***
 public:
+	Http() = default;
+	/** Waits for the asynchronous requests of this client. */
 	~Http() noexcept;
+
+	Http(const Http&) = delete;
+	Http& operator=(const Http&) = delete;
 	// ---
+
+	/** Enqueues the request, the `cb` is called with its result. */
+	void do_request_async(const RequestType request_method, const std::string& URL, const nlohmann::json& body,
+	                      const nlohmann::json& headers, std::function<void(HttpResponse&&)> cb);
+
+	/** Enqueues the request, the future gets its result. */
+	std::future<HttpResponse> do_request(const RequestType request_method, const std::string& URL,
+	                                     const nlohmann::json& body, const nlohmann::json& headers = {});
+
 	void do_POST_async(const std::string& URL, const nlohmann::json& body, const nlohmann::json& headers = {},
 	                   std::function<void(ReqCode, nlohmann::json)> cb_succ = {}, std::function<void()> cb_err = {});
 	void do_GET_async(const std::string& URL, const nlohmann::json& query, const nlohmann::json& headers = {},
@@ -61,27 +119,25 @@ public:
 	void set_allow_insecure(bool val) { _allow_insecure = val; };
 	bool get_allow_insecure() const { return _allow_insecure; };
 
+	/** Returns the latency histograms of all the requests of the process keyed by the URL without the query. */
+	static std::map<std::string, HttpLatencyHistogram> latency_histograms();
+
+	/** Logs the summary of the `latency_histograms`, meant to be called once at the shutdown. */
+	static void log_latency_stats();
+
 private:
-	void common_finish() { prune_threads(); }
-
-	void prune_threads() {
-		for (size_t i = 0; i < submit_threads.size();) {
-			if (*finish_flags[i]) {
-				submit_threads[i].join();
-				submit_threads.erase(submit_threads.begin() + i);
-				finish_flags.erase(finish_flags.begin() + i);
-			} else {
-				++i;
-			}
-		}
-	}
+	/** Number of the unfinished asynchronous requests (shared with their callbacks). */
+	struct PendingCounter {
+		std::mutex lock;
+		std::condition_variable finished;
+		size_t count{ 0 };
+	};
 
 	// *** MEMBER VARIABLES  ***
 private:
-	std::vector<std::thread> submit_threads;
-	std::vector<std::unique_ptr<bool>> finish_flags;
+	std::shared_ptr<PendingCounter> _pending{ std::make_shared<PendingCounter>() };
 
-	bool _allow_insecure;
+	bool _allow_insecure{ false };
 };
 
 };  // namespace sh
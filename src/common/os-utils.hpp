@@ -25,6 +25,12 @@
 #	include <Windows.h>
 #endif  // defined WIN32 || defined _WIN32 || defined WIN64 || defined _WIN64
 
+#ifdef __linux__
+#	include <sys/resource.h>
+#	include <sys/syscall.h>
+#	include <unistd.h>
+#endif  // __linux__
+
 #include <filesystem>
 
 namespace osutils {
@@ -133,6 +139,18 @@ inline void cd_back(std::size_t count = 1) {
 	}
 }
 
+/**
+ * Lowers the scheduling priority of the calling thread (for the background work).
+ */
+inline void lower_thread_priority() {
+#if defined WIN32 || defined _WIN32 || defined WIN64 || defined _WIN64
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#elif defined __linux__
+	// The nice value is per thread on Linux
+	setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 10);
+#endif
+}
+
 /**
  * Runs all initialization routines related to the OS.
  */
@@ -68,6 +68,8 @@ constexpr std::size_t HTTP_API_LOOP_SLEEP = 1000;
 #define TOPN_LIMIT 20000
 #define TOPKNN_LIMIT 10000
 #define SOM_ITERS 30000
+#define SOM_BATCH_SIZE 4096
+#define SOM_EPOCHS 12
 
 /** Pop-up window image grid width */
 #define DISPLAY_GRID_WIDTH 6
@@ -115,6 +117,7 @@ constexpr const char* SOM_DISPLAY = "somDisplay";
 
 constexpr const char* TOP_SCORED_DISPLAY = "topScoredDisplay";
 constexpr const char* SOM_RELOC_DISPLAY = "somRelocationDisplay";
+constexpr const char* SOM_ZOOM_DISPLAY = "somZoomDisplay";
 constexpr const char* TOP_SCORED_CONTEXT_DISPLAY = "topnContextDisplay";
 };  // namespace STD_VALUES
 
@@ -126,6 +129,7 @@ namespace ACTION_NAMES {
 constexpr const char* SHOW_RANDOM_DISPLAY = "showRandomDisplay";
 constexpr const char* SHOW_SOM_DISPLAY = "showSomDisplay";
 constexpr const char* SHOW_SOM_RELOC_DISPLAY = "showSomRelocationDisplay";
+constexpr const char* SHOW_SOM_ZOOM_DISPLAY = "showSomZoomDisplay";
 constexpr const char* SHOW_TOP_SCORED_DISPLAY = "showTopScoredDisplay";
 constexpr const char* SHOW_TOP_SCORED_CONTEXT_DISPLAY = "showTopScoredContextDisplay";
 
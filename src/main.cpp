@@ -22,6 +22,7 @@
 #include "somhunter.h"  // Do NOT move this below other includes -> libtorch hell
 // !!!
 #include "common.h"
+#include "http.h"
 #include "network-api.h"
 #include "os-utils.hpp"
 #include "utils.hpp"
@@ -43,5 +44,7 @@ int main() {
 	core.run_generators();  //< Optional
 	core.run_basic_test();  //< Optional
 
+	Http::log_latency_stats();
+
 	return 0;
 }
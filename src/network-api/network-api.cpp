@@ -655,6 +655,7 @@ void NetworkApi::initialize() {
 	push_endpoint("search/get-top-display", {}, &NetworkApi::handle__search__get_top_display__POST);
 	push_endpoint("search/get-som-display", {}, &NetworkApi::handle__search__get_som_display__POST);
 	push_endpoint("search/get-som-relocation-display", {},&NetworkApi::handle__search__get_som_relocation_display__POST);
+	push_endpoint("search/get-som-zoom-display", {}, &NetworkApi::handle__search__get_som_zoom_display__POST);
 	push_endpoint("search/keyword-autocomplete", &NetworkApi::handle__search__keyword_autocomplete__GET);
 	push_endpoint("search/reset", {}, &NetworkApi::handle__search__reset__POST);
 	push_endpoint("search/rescore", {}, &NetworkApi::handle__search__rescore__POST);
@@ -895,6 +896,43 @@ void NetworkApi::handle__search__get_som_relocation_display__POST(http_request r
 	req.reply(res);
 }
 
+void NetworkApi::handle__search__get_som_zoom_display__POST(http_request req) {
+	auto lck{ exclusive_lock() };  //< (#)
+	auto remote_addr{ to_utf8string(req.remote_address()) };
+	SHLOG_REQ(remote_addr, __func__);
+
+	FrameId frame_ID{ ERR_VAL<FrameId>() };
+	auto body = req.extract_json().get();
+	try {
+		frame_ID = static_cast<FrameId>(body[U("frameId")].as_integer());
+	} catch (...) {
+		http_response res{ construct_error_res(status_codes::BadRequest, "Invalid `frameId` parameter.") };
+		NetworkApi::add_CORS_headers(res);
+		req.reply(res);
+		return;
+	}
+
+	if (!_p_core->som_ready()) {
+		http_response res{ construct_error_res(status_codes::BadRequest, "SOM not ready!") };
+		res.set_status_code(222);
+		NetworkApi::add_CORS_headers(res);
+		req.reply(res);
+		return;
+	}
+
+	// Fetch the data.
+	auto display_frames{ _p_core->get_display(DisplayType::DSomZoom, frame_ID) };
+	json::value res_data{ to_Response__GetTopScreen__Post(_p_core, display_frames, 0, "SOM_zoom_display", "") };
+
+	// Construct the response.
+	http_response res(status_codes::OK);
+	res.set_body(res_data);
+
+	// Send the response.
+	NetworkApi::add_CORS_headers(res);
+	req.reply(res);
+}
+
 void NetworkApi::handle__dataset__video_detail__GET(http_request req) {
 	auto lck{ exclusive_lock() };  //< (#)
 	auto remote_addr{ to_utf8string(req.remote_address()) };
@@ -91,6 +91,7 @@ private:
 	void handle__search__get_top_display__POST(http_request req);
 	void handle__search__get_som_display__POST(http_request req);
 	void handle__search__get_som_relocation_display__POST(http_request req);
+	void handle__search__get_som_zoom_display__POST(http_request req);
 	void handle__search__keyword_autocomplete__GET(http_request req);
 
 	void handle__search__reset__POST(http_request req);
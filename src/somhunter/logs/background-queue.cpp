@@ -0,0 +1,76 @@
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2021 Frantisek Mejzlik <frankmejzlik@protonmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Vesely <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "background-queue.h"
+// ---
+#include "common.h"
+#include "os-utils.hpp"
+
+using namespace sh;
+
+BackgroundQueue::BackgroundQueue() : _worker{ &BackgroundQueue::worker_loop, this } {}
+
+BackgroundQueue::~BackgroundQueue() noexcept {
+	{
+		std::lock_guard lck{ _lock };
+		_terminate = true;
+	}
+	_wakeup.notify_all();
+	_worker.join();
+}
+
+void BackgroundQueue::post(Job job) {
+	{
+		std::lock_guard lck{ _lock };
+		_jobs.emplace_back(std::move(job));
+	}
+	_wakeup.notify_one();
+}
+
+void BackgroundQueue::drain() {
+	std::unique_lock lck{ _lock };
+	_idle.wait(lck, [this]() { return _jobs.empty() && !_busy; });
+}
+
+void BackgroundQueue::worker_loop() {
+	osutils::lower_thread_priority();
+
+	std::unique_lock lck{ _lock };
+	while (true) {
+		_wakeup.wait(lck, [this]() { return _terminate || !_jobs.empty(); });
+		// The pending jobs are finished even on the termination
+		if (_jobs.empty()) return;
+
+		Job job{ std::move(_jobs.front()) };
+		_jobs.pop_front();
+		_busy = true;
+
+		lck.unlock();
+		try {
+			job();
+		} catch (const std::exception& e) {
+			SHLOG_W("Background job failed: " << e.what());
+		}
+		lck.lock();
+
+		_busy = false;
+		if (_jobs.empty()) _idle.notify_all();
+	}
+}
@@ -0,0 +1,73 @@
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2021 Frantisek Mejzlik <frankmejzlik@protonmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Vesely <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef BACKGROUND_QUEUE_H_
+#define BACKGROUND_QUEUE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace sh {
+
+/**
+ * Runs the posted jobs one by one (in the posting order) on a background thread.
+ *
+ * Used for the work that must not delay the replies (writing the logs and
+ * sending them to the evaluation server). The worker thread runs with a
+ * lowered priority. The jobs still pending on destruction are run first.
+ */
+class BackgroundQueue {
+public:
+	using Job = std::function<void()>;
+
+	BackgroundQueue();
+	~BackgroundQueue() noexcept;
+
+	BackgroundQueue(const BackgroundQueue&) = delete;
+	BackgroundQueue& operator=(const BackgroundQueue&) = delete;
+
+	/** Enqueues the job behind the already posted ones. */
+	void post(Job job);
+
+	/** Waits until all the jobs posted so far are finished. */
+	void drain();
+
+private:
+	void worker_loop();
+
+	std::mutex _lock;
+	/** Signals a new job or the termination. */
+	std::condition_variable _wakeup;
+	/** Signals an empty queue. */
+	std::condition_variable _idle;
+
+	std::deque<Job> _jobs;
+	bool _busy{ false };
+	bool _terminate{ false };
+
+	std::thread _worker;
+};
+
+};  // namespace sh
+
+#endif  // BACKGROUND_QUEUE_H_
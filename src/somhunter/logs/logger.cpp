@@ -103,14 +103,19 @@ void Logger::log_query(const LogHash& hash, const Query& query) const {
 
 void Logger::submit_interaction_logs_buffer() {
 	// Send interaction logs
-	if (!_interactions_buffer.empty()) {
+	std::vector<nlohmann::json> events;
+	{
+		auto lck{ get_exclusive_actions_lock() };  //< (#)
+		events.swap(_interactions_buffer);
+	}
+
+	if (!events.empty()) {
 		nlohmann::json a = nlohmann::json{ { "timestamp", utils::timestamp() },
-			                               { "events", std::move(_interactions_buffer) },
+			                               { "events", std::move(events) },
 			                               { "type", "interaction" },
 			                               { "teamId", int(_logger_settings.team_ID) },
 			                               { "memberId", int(_logger_settings.member_ID) } };
-		_p_eval_server->send_interactions_log(a);
-		_interactions_buffer.clear();
+		_queue.post([this, a{ std::move(a) }]() { _p_eval_server->send_interactions_log(a); });
 	}
 
 	// We always reset timer
@@ -127,33 +132,6 @@ void Logger::log_results(const DatasetFrames& _dataset_frames, const ScoreModel&
 	UnixTimestamp ts{ utils::timestamp() };
 	auto hash{ gen_action_hash(ts) };
 
-	std::vector<nlohmann::json> results;
-	results.reserve(topn_imgs.size());
-
-	{
-		size_t i{ 0 };
-		for (auto&& img_ID : topn_imgs) {
-			auto vf = _dataset_frames.get_frame(img_ID);
-			std::stringstream item_ss;
-
-			// If LSC type of submit
-			if (_logger_settings.submit_LSC_IDs) {
-				item_ss << vf.LSC_id;
-				results.push_back(nlohmann::json{ { "item", item_ss.str() }, { "rank", i } });
-
-			}
-			// Non-LSC submit
-			else {
-				item_ss << std::setfill('0') << std::setw(5) << (vf.video_ID + 1);  //< !! VBS videos start from 1
-
-				results.push_back(
-				    nlohmann::json{ { "item", item_ss.str() }, { "frame", int(vf.frame_number) }, { "rank", i } });
-			}
-
-			++i;
-		}
-	}
-
 	std::set<nlohmann::json> used_cats;
 	std::set<nlohmann::json> used_types;
 	std::set<nlohmann::json> sort_types;
@@ -245,8 +223,6 @@ void Logger::log_results(const DatasetFrames& _dataset_frames, const ScoreModel&
 	}
 	query_val += ";";
 
-	nlohmann::json result_json_arr = nlohmann::json(results);
-
 	std::vector<nlohmann::json> values{ query_val };
 
 	auto filters_val{ filters_val_ss.str() };
@@ -257,10 +233,9 @@ void Logger::log_results(const DatasetFrames& _dataset_frames, const ScoreModel&
 	nlohmann::json values_arr = nlohmann::json(values);
 
 	nlohmann::json top = nlohmann::json{
-		{ "timestamp", utils::timestamp() },
+		{ "timestamp", ts },
 		{ "sortType", sort_types },
 		{ "resultSetAvailability", "top" },
-		{ "results", std::move(result_json_arr) },
 		{ "events", nlohmann::json::array() },
 		// ---
 		{ "usedCategories", used_cats },
@@ -268,19 +243,51 @@ void Logger::log_results(const DatasetFrames& _dataset_frames, const ScoreModel&
 		{ "values", values_arr },
 	};
 
-	// Send it to the eval server
-	_p_eval_server->send_results_log(top);
-
 	/* ***
-	 * Augment the log with extra data */
-	top["hash"] = hash;
-	top["serverTimestamp"] = _p_eval_server->get_server_ts();
-	top["userToken"] = _p_eval_server->get_user_token();
-	// top["currentTask"] = _p_eval_server->get_current_task();
-	// top["likes"] = likes;
-
-	// Write separate result log
-	write_result(top);
+	 * Augment the log with extra data (the eval server state is read here, not on the queue) */
+	nlohmann::json extra{ { "hash", hash },
+		                  { "serverTimestamp", _p_eval_server->get_server_ts() },
+		                  { "userToken", _p_eval_server->get_user_token() } };
+	// extra["currentTask"] = _p_eval_server->get_current_task();
+	// extra["likes"] = likes;
+
+	// The result list is built, sent and written in the background
+	_queue.post([this, p_frames{ &_dataset_frames }, topn_imgs, top{ std::move(top) },
+	             extra{ std::move(extra) }]() mutable {
+		std::vector<nlohmann::json> results;
+		results.reserve(topn_imgs.size());
+
+		size_t i{ 0 };
+		for (auto&& img_ID : topn_imgs) {
+			auto vf = p_frames->get_frame(img_ID);
+			std::stringstream item_ss;
+
+			// If LSC type of submit
+			if (_logger_settings.submit_LSC_IDs) {
+				item_ss << vf.LSC_id;
+				results.push_back(nlohmann::json{ { "item", item_ss.str() }, { "rank", i } });
+
+			}
+			// Non-LSC submit
+			else {
+				item_ss << std::setfill('0') << std::setw(5) << (vf.video_ID + 1);  //< !! VBS videos start from 1
+
+				results.push_back(
+				    nlohmann::json{ { "item", item_ss.str() }, { "frame", int(vf.frame_number) }, { "rank", i } });
+			}
+
+			++i;
+		}
+		top["results"] = std::move(results);
+
+		// Send it to the eval server
+		_p_eval_server->send_results_log(top);
+
+		// Write separate result log
+		top.insert(extra.begin(), extra.end());
+		write_result(top);
+	});
+
 	// Write the action
 	push_action("reportResults", "OTHER", "reportResults", "");
 }
@@ -352,7 +359,7 @@ void Logger::log_canvas_query(const std::vector<TemporalQuery>& /*temp_queries*/
 void sh::Logger::log_rescore(const Query& /*prev_query*/, const Query& new_query) {
 	// Log query
 	auto h{ push_action("rescore", "OTHER ", "rescore", "") };
-	log_query(h, new_query);
+	_queue.post([this, h, new_query]() { log_query(h, new_query); });
 }
 
 void Logger::log_text_query_change(const std::string& text_query) {
@@ -418,6 +425,11 @@ void Logger::log_show_som_relocation_display(const DatasetFrames& /*frames*/, co
 	            STD_VALUES::SOM_RELOC_DISPLAY);
 }
 
+void Logger::log_show_som_zoom_display(const DatasetFrames& /*frames*/, const std::vector<FrameId>& /*imgs*/) {
+	push_action(ACTION_NAMES::SHOW_SOM_ZOOM_DISPLAY, STD_CATEGORIES::BROWSING, STD_TYPES::EXPLORATION,
+	            STD_VALUES::SOM_ZOOM_DISPLAY);
+}
+
 void Logger::log_show_topn_display(const DatasetFrames& /*frames*/, const std::vector<FrameId>& /*imgs*/) {
 	push_action(ACTION_NAMES::SHOW_TOP_SCORED_DISPLAY, STD_CATEGORIES::BROWSING, STD_TYPES::RANKED_LIST,
 	            STD_VALUES::TOP_SCORED_DISPLAY);
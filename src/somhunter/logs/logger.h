@@ -31,6 +31,7 @@
 // ---
 #include <nlohmann/json.hpp>
 // ---
+#include "background-queue.h"
 #include "canvas-query-ranker.h"
 #include "common.h"
 #include "dataset-frames.h"
@@ -61,6 +62,9 @@ public:
 	/** Does periodic cleanup & log flush. */
 	void poll();
 
+	/** Waits until the queued logs are written and sent. */
+	void flush() { _queue.drain(); }
+
 	void log_search_context_switch(std::size_t dest_context_ID, size_t src_context_ID);
 
 	/** Called whenever we want to log submit frame/shot into the server. */
@@ -72,7 +76,11 @@ public:
 
 	void log_rescore(const Query& prev_query, const Query& new_query);
 
-	/** Called whenever we rescore. */
+	/**
+	 * Called whenever we rescore.
+	 *
+	 * Only the action is logged right away, the result list is built, sent and written in the background.
+	 */
 	void log_results(const DatasetFrames& _dataset_frames, const ScoreModel& scores, const std::set<FrameId>& likes,
 	                 const UsedTools& used_tools, DisplayType disp_type, const std::vector<FrameId>& topn_imgs,
 	                 const std::string& sentence_query, const size_t topn_frames_per_video,
@@ -91,6 +99,8 @@ public:
 
 	void log_show_som_relocation_display(const DatasetFrames& _dataset_frames, const std::vector<FrameId>& imgs);
 
+	void log_show_som_zoom_display(const DatasetFrames& _dataset_frames, const std::vector<FrameId>& imgs);
+
 	void log_show_random_display(const DatasetFrames& _dataset_frames, const std::vector<FrameId>& imgs);
 
 	void log_show_topn_display(const DatasetFrames& _dataset_frames, const std::vector<FrameId>& imgs);
@@ -108,16 +118,19 @@ public:
 
 	void log_reset_search();
 
-	/** Sends the accumulated logs to the evaluation server (through `_p_eval_server`). */
+	/** Sends the accumulated logs to the evaluation server (through `_p_eval_server`) in the background. */
 	void submit_interaction_logs_buffer();
 
 	DebugLogStreamPtrs get_debug_streams() {
+		// The queued result logs write into the streams
+		flush();
 		return DebugLogStreamPtrs{ _summary_streams.emplace_back(std::stringstream{}),
 			                       _actions_streams.emplace_back(std::stringstream{}),
 			                       _results_streams.emplace_back(std::stringstream{}) };
 	};
 
 	void clear_debug_streams() {
+		flush();
 		_summary_streams.clear();
 		_actions_streams.clear();
 		_results_streams.clear();
@@ -221,6 +234,13 @@ private:
 	bool _first_actions{ true };
 
 	mutable std::mutex _push_action_mtx;
+
+	/**
+	 * The result logs, the query dumps and all the requests to the eval server are done here (in order).
+	 *
+	 * Declared last so that it finishes the pending jobs before the rest is destroyed.
+	 */
+	BackgroundQueue _queue;
 };
 
 };  // namespace sh
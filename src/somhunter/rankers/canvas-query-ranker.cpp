@@ -21,8 +21,13 @@
 
 #include "canvas-query-ranker.h"
 
+#include <array>
+#include <chrono>
+#include <execution>
 #include <filesystem>
+#include <map>
 
+#include "embedding-ranker.h"
 #include "keyword-ranker.h"
 #include "scores.h"
 #include "utils.hpp"
@@ -35,7 +40,9 @@ using namespace sh;
 #endif
 
 CanvasQueryRanker::CanvasQueryRanker(const Settings& _settings, KeywordRanker* p_core)
-    : _p_core{ p_core }, _loaded{ false } {
+    : _p_core{ p_core },
+      _loaded{ false },
+      _bitmap_features{ _settings.models.canvas_features_cache_size } {
 	SHLOG_D("Initializing CanvasQueryRanker...");
 
 	// Check if we have subregions data
@@ -45,20 +52,49 @@ CanvasQueryRanker::CanvasQueryRanker(const Settings& _settings, KeywordRanker* p
 		return;
 	}
 
+	// Torch thread pools (otherwise sized to all the cores, competing with the scoring)
+	if (_settings.models.torch_threads > 0) {
+		at::set_num_threads(int(_settings.models.torch_threads));
+	}
+	if (_settings.models.torch_interop_threads > 0) {
+		try {
+			at::set_num_interop_threads(int(_settings.models.torch_interop_threads));
+		} catch (const c10::Error& e) {
+			SHLOG_W("Unable to set the torch inter-op threads (already in use): " << e.what());
+		}
+	}
+	SHLOG_I("Torch uses " << at::get_num_threads() << " intra-op and " << at::get_num_interop_threads()
+	                      << " inter-op threads.");
+
+	// The int8 quantized models replace the FP32 ones if wanted (and provided)
+	const bool int8_models{ _settings.models.use_int8_models && !_settings.models.model_ResNet_int8_file.empty() &&
+		                    !_settings.models.model_ResNext_int8_file.empty() };
+	if (_settings.models.use_int8_models && !int8_models) {
+		SHLOG_W("The int8 models are not configured, using the FP32 ones.");
+	}
+	const std::string& resnet_file{ int8_models ? _settings.models.model_ResNet_int8_file
+		                                        : _settings.models.model_ResNet_file };
+	const std::string& resnext_file{ int8_models ? _settings.models.model_ResNext_int8_file
+		                                         : _settings.models.model_ResNext_file };
+	if (int8_models) {
+		SHLOG_I("Using the int8 models with the '" << c10::toString(at::globalContext().qEngine())
+		                                           << "' quantized engine.");
+	}
+
 	try {
-		if (!_settings.models.model_ResNet_file.empty()) {
-			if (!std::filesystem::exists(_settings.models.model_ResNet_file)) {
-				std::string msg{ "Unable to open file '" + _settings.models.model_ResNet_file + "'." };
+		if (!resnet_file.empty()) {
+			if (!std::filesystem::exists(resnet_file)) {
+				std::string msg{ "Unable to open file '" + resnet_file + "'." };
 				SHLOG_E(msg);
 				throw std::runtime_error{ msg };
 			}
-			resnet152 = torch::jit::load(_settings.models.model_ResNet_file);
-			SHLOG_S("ResNet model loaded from  '" << _settings.models.model_ResNet_file << "'.");
+			resnet152 = torch::jit::load(resnet_file);
+			SHLOG_S("ResNet model loaded from  '" << resnet_file << "'.");
 		} else {
 			SHLOG_W("ResNet model is ignored!");
 		}
 	} catch (const c10::Error& e) {
-		std::string msg{ "Error openning ResNet model file: " + _settings.models.model_ResNet_file + "\n" + e.what() };
+		std::string msg{ "Error openning ResNet model file: " + resnet_file + "\n" + e.what() };
 		msg.append(
 		    "\n\nAre you on Windows? Have you forgotten to rerun CMake with appropriate CMAKE_BUILD_TYPE value? "
 		    "Windows libtorch debug/release libs are NOT ABI compatible.");
@@ -67,9 +103,9 @@ CanvasQueryRanker::CanvasQueryRanker(const Settings& _settings, KeywordRanker* p
 	}
 
 	try {
-		if (!_settings.models.model_ResNext_file.empty()) {
-			if (!std::filesystem::exists(_settings.models.model_ResNext_file)) {
-				std::string msg{ "Unable to open file '" + _settings.models.model_ResNext_file + "'." };
+		if (!resnext_file.empty()) {
+			if (!std::filesystem::exists(resnext_file)) {
+				std::string msg{ "Unable to open file '" + resnext_file + "'." };
 				msg.append(
 				    "\n\nAre you on Windows? Have you forgotten to rerun CMake with appropriate CMAKE_BUILD_TYPE "
 				    "value? "
@@ -77,13 +113,13 @@ CanvasQueryRanker::CanvasQueryRanker(const Settings& _settings, KeywordRanker* p
 				SHLOG_E(msg);
 				throw std::runtime_error{ msg };
 			}
-			resnext101 = torch::jit::load(_settings.models.model_ResNext_file);
-			SHLOG_S("ResNext model loaded from  '" << _settings.models.model_ResNext_file << "'.");
+			resnext101 = torch::jit::load(resnext_file);
+			SHLOG_S("ResNext model loaded from  '" << resnext_file << "'.");
 		} else {
 			SHLOG_W("ResNext model is ignored!");
 		}
 	} catch (const c10::Error& e) {
-		std::string msg{ "Error openning ResNext model file: " + _settings.models.model_ResNext_file + "\n" +
+		std::string msg{ "Error openning ResNext model file: " + resnext_file + "\n" +
 			             e.what() };
 		SHLOG_E(msg);
 		throw std::runtime_error(msg);
@@ -130,10 +166,24 @@ CanvasQueryRanker::CanvasQueryRanker(const Settings& _settings, KeywordRanker* p
 	                                        << _settings.datasets.primary_features.pre_PCA_features_dim << ").");
 
 	try {
-		for (std::size_t i = 0; i < _settings.datasets.primary_features.collage_regions; i++) {
-			FeatureMatrix m = KeywordRanker::parse_float_matrix(
-			    _settings.datasets.primary_features.collage_region_file_prefix + std::to_string(i) + ".bin", 128, 0);
-			region_data.push_back(m);
+		const auto& prefix{ _settings.datasets.primary_features.collage_region_file_prefix };
+		const size_t num_regions{ _settings.datasets.primary_features.collage_regions };
+
+		// All the regions go into one [region][frame][dim] array, each file is read at once
+		for (std::size_t i = 0; i < num_regions; i++) {
+			auto region{ KeywordRanker::parse_flat_float_matrix(prefix + std::to_string(i) + ".bin", region_dim, 0) };
+			size_t num_frames{ region.size() / region_dim };
+
+			if (i == 0) {
+				_num_region_frames = num_frames;
+				_region_features.reserve(num_regions * num_frames * region_dim);
+			} else if (num_frames != _num_region_frames) {
+				std::string msg{ "Region " + std::to_string(i) + " has " + std::to_string(num_frames) +
+					             " frames, expected " + std::to_string(_num_region_frames) + "." };
+				SHLOG_E(msg);
+				throw std::runtime_error(msg);
+			}
+			_region_features.insert(_region_features.end(), region.begin(), region.end());
 		}
 		SHLOG_S("Loaded " << _settings.datasets.primary_features.collage_regions << " from prefix  '"
 		                  << _settings.datasets.primary_features.collage_region_file_prefix << "'.");
@@ -144,6 +194,11 @@ CanvasQueryRanker::CanvasQueryRanker(const Settings& _settings, KeywordRanker* p
 		throw std::runtime_error(msg);
 	}
 
+	// The first passes pay the graph optimization and allocations, do not let users pay it
+	if (_settings.models.warmup_passes > 0 && !resnet_file.empty() && !resnext_file.empty()) {
+		warm_up(_settings.models.warmup_passes);
+	}
+
 	_loaded = true;
 	SHLOG_S("CanvasQueryRanker initialized.");
 }
@@ -157,29 +212,69 @@ void CanvasQueryRanker::score(const CanvasQuery& canvas_query, ScoreModel& model
 	}
 
 	if (canvas_query.size() > 0) {
-		at::Tensor tensor_features = get_features(canvas_query, used_tools);
-
-		// Convert tensor to STD containered matrix
-		auto collage_vectors{ to_std_matrix<float>(tensor_features) };
+		at::Tensor tensor_features = get_features(canvas_query, used_tools).contiguous();
+		if (size_t(tensor_features.sizes()[1]) != region_dim) {
+			SHLOG_E("Canvas query features are not of the region dimension (" << region_dim << ").");
+			return;
+		}
 
 		// get best IOU regions for each image in collage
 		auto regions = get_RoIs(canvas_query);
 
-		// get scores for all collage images and whole dataset of region
-		std::vector<std::vector<float>> scores;
-		for (std::size_t i = 0; i < collage_vectors.size(); i++)
-			scores.push_back(score_image(collage_vectors[i], regions[i]));
+		do_assert(model.size() == _num_region_frames, "Region features must cover all the frames.");
+
+		// Average score of all collage images straight into the model
+		score_regions(tensor_features.data_ptr<float>(), regions, model.temp_data(temporal));
+	}
+}
+
+/** The key of the bitmap features in the cache: the hash of the dimensions and pixels. */
+static std::string bitmap_key(const CanvasSubqueryBitmap& bitmap) {
+	const uint64_t dims[]{ bitmap.width_pixels(), bitmap.height_pixels(), bitmap.num_channels() };
 
-		auto final_score = average_scores(scores);
-		auto sorted_results{ ScoreModel::sort_by_score(final_score) };
+	SHA256 sha;
+	sha.add(dims, sizeof(dims));
+	sha.add(bitmap.data().data(), bitmap.data().size());
+	return sha.getHash();
+}
+
+void CanvasQueryRanker::prepare_bitmaps(const std::vector<const CanvasQuery*>& canvases) {
+	// Without the cache, there is nowhere to keep the batch results
+	if (!_loaded || _bitmap_features.capacity() == 0) return;
+
+	// The distinct bitmaps missing in the cache
+	std::vector<const CanvasSubqueryBitmap*> bitmaps;
+	std::vector<std::string> keys;
+	for (auto&& p_canvas : canvases) {
+		for (std::size_t i = 0; i < p_canvas->size(); i++) {
+			const auto& subquery{ (*p_canvas)[i] };
+			if (!std::holds_alternative<CanvasSubqueryBitmap>(subquery)) continue;
 
-		// KeywordRanker::report_results(sorted_results, _dataset_frames);
+			const CanvasSubqueryBitmap& bitmap{ std::get<CanvasSubqueryBitmap>(subquery) };
+			std::string key{ bitmap_key(bitmap) };
+			if (std::find(keys.begin(), keys.end(), key) != keys.end() || _bitmap_features.contains(key)) continue;
 
-		// Update the model
-		for (size_t i = 0; i < final_score.size(); ++i) {
-			model.adjust(temporal, i, final_score[i]);
+			bitmaps.emplace_back(&bitmap);
+			keys.emplace_back(std::move(key));
 		}
 	}
+
+	if (!bitmaps.empty()) {
+		SHLOG_D("Encoding " << bitmaps.size() << " canvas bitmaps in one batch...");
+		store_bitmap_features(keys, encode_bitmaps(bitmaps));
+	}
+}
+
+void CanvasQueryRanker::warm_up(size_t passes) {
+	SHLOG_I("Warming up the canvas CNNs (" << passes << " passes)...");
+
+	auto start{ std::chrono::steady_clock::now() };
+	at::Tensor blank{ torch::zeros(
+		{ 1, int64_t(models_num_channels), int64_t(models_input_height), int64_t(models_input_width) }) };
+	for (size_t i = 0; i < passes; ++i) bitmap_features(blank, blank);
+
+	auto dur{ std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start) };
+	SHLOG_S("Canvas CNNs warmed up in " << dur.count() << " ms.");
 }
 
 // in 1st dim
@@ -195,49 +290,33 @@ at::Tensor CanvasQueryRanker::get_L2norm(const at::Tensor& _data) const {
 at::Tensor CanvasQueryRanker::get_features(const CanvasQuery& collage, UsedTools& used_tools) {
 	SHLOG_D("Extracting features");
 
-	torch::NoGradGuard no_grad;
-	std::vector<torch::Tensor> tensors;
-	std::vector<torch::Tensor> tensors_bitmap_norm;
+	// Features of each subquery in the collage order
+	std::vector<at::Tensor> mixed_tensor(collage.size());
 
-	std::vector<torch::Tensor> tensors_text;
-	at::Tensor features_text;
-	at::Tensor features_bitmap;
+	// Bitmaps missing in the cache and their positions
+	std::vector<const CanvasSubqueryBitmap*> bitmaps;
+	std::vector<std::string> bitmap_keys;
+	std::vector<std::size_t> bitmap_positions;
 
-	float means[] = { 123.68, 116.779, 103.939 };
-	torch::Tensor t_means = torch::from_blob(means, { 3 }).unsqueeze_(0).unsqueeze_(0);
-
-	// get data, no adjustements for resnet, normed for resnext
 	for (std::size_t i = 0; i < collage.size(); i++) {
-		auto subquery{ collage[i] };
+		const auto& subquery{ collage[i] };
 
 		// If bitmap
 		if (std::holds_alternative<CanvasSubqueryBitmap>(subquery)) {
 			// Set used tool
 			used_tools.canvas_bitmap_used = true;
 
-			CanvasSubqueryBitmap& subquery_bitmap{ std::get<CanvasSubqueryBitmap>(subquery) };
-			auto scaled_bitmap{ subquery_bitmap.get_scaled_bitmap(224, 224) };
+			const CanvasSubqueryBitmap& subquery_bitmap{ std::get<CanvasSubqueryBitmap>(subquery) };
 
-			/*ImageManipulator::store_PNG("pre-scale-bitmap.png", subquery_bitmap.data(),
-			subquery_bitmap.width_pixels(), subquery_bitmap.height_pixels(), 3);
-			ImageManipulator::store_PNG("post-scale-bitmap.png", scaled_bitmap, 224, 224, 3);*/
-
-			// !!!
-			at::Tensor tensor_imagex = torch::from_blob(scaled_bitmap.data(), { 224, 224, 3 }, at::kByte);
-			// This is not needed, torch seems to accept the above data
-			/*auto ddata{ImageManipulator::to_float32(scaled_bitmap)};
-			at::Tensor tensor_imagex = torch::from_blob(ddata.data(), { 224, 224, 3 }, at::kFloat);*/
-
-			at::Tensor tensor_image = tensor_imagex - 0.0F;
-			at::Tensor tensor_image_norm = tensor_imagex - t_means;
-
-			tensor_image = tensor_image.permute({ 2, 0, 1 });
-
-			tensor_image_norm = tensor_image_norm.permute({ 2, 0, 1 });
-
-			tensors.push_back(tensor_image.unsqueeze_(0));
-
-			tensors_bitmap_norm.push_back(tensor_image_norm.unsqueeze_(0));
+			// Unchanged bitmaps skip the inference
+			std::string key{ bitmap_key(subquery_bitmap) };
+			if (auto cached{ _bitmap_features.find(key) }; cached.has_value()) {
+				mixed_tensor[i] = to_tensor<at::kFloat, float>(*cached);
+				continue;
+			}
+			bitmaps.emplace_back(&subquery_bitmap);
+			bitmap_keys.emplace_back(std::move(key));
+			bitmap_positions.emplace_back(i);
 		}
 		// Else text
 		else {
@@ -246,69 +325,96 @@ at::Tensor CanvasQueryRanker::get_features(const CanvasQuery& collage, UsedTools
 
 			CanvasSubqueryText subquery_text{ std::get<CanvasSubqueryText>(subquery) };
 			auto fea{ _p_core->get_text_query_feature(subquery_text.query()) };
-			tensors_text.emplace_back(to_tensor<at::kFloat, float>(fea));
+			mixed_tensor[i] = to_tensor<at::kFloat, float>(fea);
 		}
 	}
 
-	// Stack the TEXT features into one tensor
-	if (tensors_text.size() > 0) {
-		features_text = torch::stack(tensors_text, 0);
+	if (!bitmaps.empty()) {
+		at::Tensor features_bitmap{ encode_bitmaps(bitmaps) };
+		store_bitmap_features(bitmap_keys, features_bitmap);
+
+		for (size_t j = 0; j < bitmap_positions.size(); ++j) mixed_tensor[bitmap_positions[j]] = features_bitmap[j];
 	}
 
-	// Stack the BITMAP features into one tensor
-	if (tensors.size() > 0) {
-		at::Tensor batch = torch::cat(tensors, 0);
-		at::Tensor batch_norm = torch::cat(tensors_bitmap_norm, 0);
+	// Final stack
+	at::Tensor result_features = torch::stack(mixed_tensor, 0);
+	// std::cout << "result_features.shape: " << result_features.sizes() << std::endl;
+	// std::cout << result_features << std::endl;
 
-		auto resnext101_forward = resnext101.forward({ batch_norm });
-		auto resnet125_forward = resnet152.forward({ batch });
-		at::Tensor resnext101_feature = resnext101_forward.toTensor();
-		at::Tensor resnet152_feature = resnet125_forward.toTensor();
-		features_bitmap = torch::cat({ resnext101_feature, resnet152_feature }, 1).to(torch::kFloat32).detach();
+	return result_features;
+}
 
-		// squeeze 4096 to 2048
-		features_bitmap = features_bitmap.unsqueeze(0).permute({ 1, 0, 2 });
-		features_bitmap = torch::tanh(torch::matmul(features_bitmap, weights).squeeze(1) + bias);
+at::Tensor CanvasQueryRanker::encode_bitmaps(const std::vector<const CanvasSubqueryBitmap*>& bitmaps) {
+	std::vector<torch::Tensor> tensors;
+	std::vector<torch::Tensor> tensors_bitmap_norm;
 
-		// norm
-		features_bitmap = torch::div(features_bitmap, get_L2norm(features_bitmap));
+	float means[] = { 123.68, 116.779, 103.939 };
+	torch::Tensor t_means = torch::from_blob(means, { 3 }).unsqueeze_(0).unsqueeze_(0);
 
-		// PCA
-		features_bitmap = features_bitmap - kw_pca_mean_vec;
-		features_bitmap = features_bitmap.unsqueeze(0).permute({ 1, 0, 2 });
-		features_bitmap = torch::matmul(features_bitmap, kw_pca_mat).squeeze(1);
+	// get data, no adjustements for resnet, normed for resnext
+	for (auto&& p_bitmap : bitmaps) {
+		auto scaled_bitmap{ p_bitmap->get_scaled_bitmap(224, 224) };
 
-		// norm
-		features_bitmap = torch::div(features_bitmap, get_L2norm(features_bitmap));
-	}
-	// --------------------------------------------
-	// Merge text & bitmap features into one matrix
-	std::vector<torch::Tensor> mixed_tensor;
-	{
-		size_t bitmap_i{ 0 };
-		size_t text_i{ 0 };
-		for (std::size_t i = 0; i < collage.size(); i++) {
-			auto subquery{ collage[i] };
-
-			// If bitmap
-			if (std::holds_alternative<CanvasSubqueryBitmap>(subquery)) {
-				mixed_tensor.emplace_back(features_bitmap[bitmap_i]);
-				++bitmap_i;
-			}
-			// Else text
-			else {
-				mixed_tensor.emplace_back(features_text[text_i]);
-				++text_i;
-			}
-		}
+		/*ImageManipulator::store_PNG("pre-scale-bitmap.png", subquery_bitmap.data(),
+		subquery_bitmap.width_pixels(), subquery_bitmap.height_pixels(), 3);
+		ImageManipulator::store_PNG("post-scale-bitmap.png", scaled_bitmap, 224, 224, 3);*/
+
+		// !!!
+		at::Tensor tensor_imagex = torch::from_blob(scaled_bitmap.data(), { 224, 224, 3 }, at::kByte);
+		// This is not needed, torch seems to accept the above data
+		/*auto ddata{ImageManipulator::to_float32(scaled_bitmap)};
+		at::Tensor tensor_imagex = torch::from_blob(ddata.data(), { 224, 224, 3 }, at::kFloat);*/
+
+		at::Tensor tensor_image = tensor_imagex - 0.0F;
+		at::Tensor tensor_image_norm = tensor_imagex - t_means;
+
+		tensor_image = tensor_image.permute({ 2, 0, 1 });
+
+		tensor_image_norm = tensor_image_norm.permute({ 2, 0, 1 });
+
+		tensors.push_back(tensor_image.unsqueeze_(0));
+
+		tensors_bitmap_norm.push_back(tensor_image_norm.unsqueeze_(0));
 	}
 
-	// Final stack
-	at::Tensor result_features = torch::stack(mixed_tensor, 0);
-	// std::cout << "result_features.shape: " << result_features.sizes() << std::endl;
-	// std::cout << result_features << std::endl;
+	at::Tensor batch = torch::cat(tensors, 0);
+	at::Tensor batch_norm = torch::cat(tensors_bitmap_norm, 0);
 
-	return result_features;
+	return bitmap_features(batch, batch_norm);
+}
+
+at::Tensor CanvasQueryRanker::bitmap_features(const at::Tensor& batch, const at::Tensor& batch_norm) {
+	torch::NoGradGuard no_grad;
+
+	auto resnext101_forward = resnext101.forward({ batch_norm });
+	auto resnet125_forward = resnet152.forward({ batch });
+	at::Tensor resnext101_feature = resnext101_forward.toTensor();
+	at::Tensor resnet152_feature = resnet125_forward.toTensor();
+	at::Tensor features_bitmap = torch::cat({ resnext101_feature, resnet152_feature }, 1).to(torch::kFloat32).detach();
+
+	// squeeze 4096 to 2048
+	features_bitmap = features_bitmap.unsqueeze(0).permute({ 1, 0, 2 });
+	features_bitmap = torch::tanh(torch::matmul(features_bitmap, weights).squeeze(1) + bias);
+
+	// norm
+	features_bitmap = torch::div(features_bitmap, get_L2norm(features_bitmap));
+
+	// PCA
+	features_bitmap = features_bitmap - kw_pca_mean_vec;
+	features_bitmap = features_bitmap.unsqueeze(0).permute({ 1, 0, 2 });
+	features_bitmap = torch::matmul(features_bitmap, kw_pca_mat).squeeze(1);
+
+	// norm
+	return torch::div(features_bitmap, get_L2norm(features_bitmap)).contiguous();
+}
+
+void CanvasQueryRanker::store_bitmap_features(const std::vector<std::string>& keys, const at::Tensor& features) {
+	const float* p_features{ features.data_ptr<float>() };
+	const size_t dim{ size_t(features.sizes()[1]) };
+	for (auto&& key : keys) {
+		_bitmap_features.store(key, std::vector<float>(p_features, p_features + dim));
+		p_features += dim;
+	}
 }
 
 std::vector<std::size_t> CanvasQueryRanker::get_RoIs(const CanvasQuery& collage) const {
@@ -342,25 +448,27 @@ std::size_t CanvasQueryRanker::get_RoI(const CanvasSubquery& image) const {
 	return std::distance(iou.begin(), std::max_element(iou.begin(), iou.end()));
 }
 
-std::vector<float> CanvasQueryRanker::score_image(const std::vector<float>& feature, std::size_t region) const {
-	std::vector<float> score;
-	for (size_t i = 0; i < region_data[region].size(); i++)
-		score.push_back(d_cos_normalized(feature.data(), region_data[region][i].data(), feature.size()) / 2);
-	return score;
-}
-
-std::vector<float> CanvasQueryRanker::average_scores(const std::vector<std::vector<float>>& scores) const {
-	size_t count = scores.size();
-	std::vector<float> result;
-
-	if (count == 0) return result;
-
-	for (size_t i = 0; i < scores[0].size(); i++) {
-		float sum = 0;
-		for (size_t j = 0; j < count; j++) {
-			sum += scores[j][i];
+void CanvasQueryRanker::score_regions(const float* features, const std::vector<std::size_t>& regions,
+                                      float* scores) const {
+	const size_t num_blocks{ (_num_region_frames + INVERSE_SCORE_BLOCK_ROWS - 1) / INVERSE_SCORE_BLOCK_ROWS };
+	const float inv_count{ 1.0F / regions.size() };
+
+	std::for_each(std::execution::par_unseq, ioterable<size_t>(0), ioterable<size_t>(num_blocks), [&](size_t b) {
+		const size_t from{ b * INVERSE_SCORE_BLOCK_ROWS };
+		const size_t count{ std::min(INVERSE_SCORE_BLOCK_ROWS, _num_region_frames - from) };
+
+		// Sum of the dot products of all the subqueries in this block (the buffers stay in the cache)
+		std::array<float, INVERSE_SCORE_BLOCK_ROWS> sums;
+		std::array<float, INVERSE_SCORE_BLOCK_ROWS> dots;
+		for (size_t j = 0; j < regions.size(); ++j) {
+			float* out{ j == 0 ? sums.data() : dots.data() };
+			d_dot_rows(region_fv(regions[j], from), count, region_dim, features + j * region_dim, out);
+			if (j > 0)
+				for (size_t i = 0; i < count; ++i) sums[i] += dots[i];
 		}
-		result.push_back(sum / count);
-	}
-	return result;
+
+		// The average of halved cosine distances, multiplied into the scores
+		float* block_scores{ scores + from };
+		for (size_t i = 0; i < count; ++i) block_scores[i] *= (1.0F - sums[i] * inv_count) / 2.0F;
+	});
 }
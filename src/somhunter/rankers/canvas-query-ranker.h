@@ -37,6 +37,7 @@
 
 #include "common.h"
 
+#include "embedding-cache.h"
 #include "image-processor.h"
 #include "keyword-ranker.h"
 #include "query-types.h"
@@ -120,17 +121,45 @@ public:
 	void score(const CanvasQuery&, ScoreModel& model, size_t temporal, UsedTools& used_tools,
 	           const PrimaryFrameFeatures& _dataset_features, const DatasetFrames& _dataset_frames);
 
+	/**
+	 * Encodes all the bitmaps of the canvases that are not cached yet in one forward pass (into the cache),
+	 * so scoring the canvases one by one does no more inference.
+	 */
+	void prepare_bitmaps(const std::vector<const CanvasQuery*>& canvases);
+
 private:
-	std::vector<FeatureMatrix> region_data;
+	/** Dimension of the region features. */
+	static const size_t region_dim{ 128 };
+
+	/** Features of all the regions of all the frames as one contiguous [region][frame][dim] array. */
+	std::vector<float> _region_features;
+	size_t _num_region_frames{ 0 };
+
+	/** Final (PCA-ed, normalized) features of the recent bitmaps keyed by the hash of their pixels. */
+	EmbeddingCache _bitmap_features;
+
+	const float* region_fv(size_t region, size_t frame) const {
+		return _region_features.data() + (region * _num_region_frames + frame) * region_dim;
+	}
 
 	at::Tensor get_features(const CanvasQuery&, UsedTools& used_tools);
+	/** Returns the final features of the bitmaps (one row each). */
+	at::Tensor encode_bitmaps(const std::vector<const CanvasSubqueryBitmap*>& bitmaps);
+	/** Runs the CNNs, the W2VV FC layer and the PCA on the batch (and the mean-subtracted one for ResNeXt). */
+	at::Tensor bitmap_features(const at::Tensor& batch, const at::Tensor& batch_norm);
+	void store_bitmap_features(const std::vector<std::string>& keys, const at::Tensor& features);
+	/** Runs the inference `passes` times on a blank bitmap. */
+	void warm_up(size_t passes);
 	at::Tensor get_L2norm(const at::Tensor& _data) const;
 
 	std::vector<std::size_t> get_RoIs(const CanvasQuery& collage) const;
 	std::size_t get_RoI(const CanvasSubquery& image) const;
 
-	std::vector<float> score_image(const std::vector<float>& feature, std::size_t region) const;
-	std::vector<float> average_scores(const std::vector<std::vector<float>>& scores) const;
+	/**
+	 * Multiplies `scores` by the average inverse score of the subquery features (`regions.size()` rows of
+	 * `region_dim` floats) against their regions, in one parallel pass over the frames.
+	 */
+	void score_regions(const float* features, const std::vector<std::size_t>& regions, float* scores) const;
 };
 
 // This serves for default parameters of type Collage&
@@ -0,0 +1,207 @@
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2021 Frantisek Mejzlik <frankmejzlik@protonmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Vesely <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "embedding-cache.h"
+// ---
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <system_error>
+#include <utility>
+// ---
+#include "common.h"
+
+using namespace sh;
+
+/** Tag at the beginning of the cache file. */
+static constexpr uint32_t CACHE_FILE_MAGIC = 0x43455343;  //< "CSEC"
+
+/** The longest key accepted from the cache file. */
+static constexpr uint32_t CACHE_FILE_MAX_KEY_LEN = 1 << 16;
+
+EmbeddingCache::EmbeddingCache(size_t capacity, size_t dim, const std::string& filepath)
+    : _capacity{ capacity }, _dim{ dim }, _filepath{ filepath } {
+	if (_filepath.empty()) return;
+
+	load();
+	_saver = std::make_unique<BackgroundQueue>();
+}
+
+std::optional<std::vector<float>> EmbeddingCache::find(const std::string& key) {
+	std::lock_guard lck{ _lock };
+
+	auto it{ _items.find(key) };
+	if (it == _items.end()) return std::nullopt;
+
+	_lru.splice(_lru.begin(), _lru, it->second.second);
+	return it->second.first;
+}
+
+void EmbeddingCache::store(const std::string& key, std::vector<float> embedding) {
+	if (_capacity == 0) return;
+
+	{
+		std::lock_guard lck{ _lock };
+
+		auto it{ _items.find(key) };
+		if (it != _items.end()) {
+			it->second.first = std::move(embedding);
+			_lru.splice(_lru.begin(), _lru, it->second.second);
+			return;
+		}
+
+		_lru.push_front(key);
+		_items.emplace(key, std::make_pair(std::move(embedding), _lru.begin()));
+		evict_over_capacity();
+
+		if (_filepath.empty() || ++_num_unsaved < SAVE_PERIOD || _save_pending) return;
+		_save_pending = true;
+	}
+
+	// Do not rely on the owner's final save only (killed processes do not run it)
+	_saver->post([this]() { save(); });
+}
+
+bool EmbeddingCache::contains(const std::string& key) const {
+	std::lock_guard lck{ _lock };
+	return _items.count(key) > 0;
+}
+
+size_t EmbeddingCache::size() const {
+	std::lock_guard lck{ _lock };
+	return _items.size();
+}
+
+void EmbeddingCache::evict_over_capacity() {
+	while (_items.size() > _capacity) {
+		_items.erase(_lru.back());
+		_lru.pop_back();
+	}
+}
+
+/*
+ * FORMAT (little-endian):
+ *    uint32 magic, uint32 count
+ *    count times: uint32 key length, key bytes, uint32 dim, dim * 4B floats
+ * The entries are ordered from the least recently used one.
+ */
+
+void EmbeddingCache::save() const {
+	if (_filepath.empty()) return;
+
+	std::lock_guard save_lck{ _save_lock };
+
+	std::vector<std::pair<std::string, std::vector<float>>> entries;
+	{
+		std::lock_guard lck{ _lock };
+		entries.reserve(_items.size());
+		for (auto it = _lru.rbegin(); it != _lru.rend(); ++it) entries.emplace_back(*it, _items.at(*it).first);
+
+		_num_unsaved = 0;
+		_save_pending = false;
+	}
+
+	// Written aside and renamed, so that a crash while writing never leaves a truncated file
+	const std::string tmp_filepath{ _filepath + ".tmp" };
+	std::ofstream ofs(tmp_filepath, std::ios::binary | std::ios::trunc);
+	if (!ofs) {
+		SHLOG_W("Could not write the embedding cache to '" << tmp_filepath << "'.");
+		return;
+	}
+
+	auto write_u32 = [&ofs](uint32_t v) { ofs.write(reinterpret_cast<const char*>(&v), sizeof(v)); };
+
+	write_u32(CACHE_FILE_MAGIC);
+	write_u32(uint32_t(entries.size()));
+	for (auto&& [key, embedding] : entries) {
+		write_u32(uint32_t(key.size()));
+		ofs.write(key.data(), key.size());
+		write_u32(uint32_t(embedding.size()));
+		ofs.write(reinterpret_cast<const char*>(embedding.data()), embedding.size() * sizeof(float));
+	}
+	ofs.close();
+
+	std::error_code ec;
+	if (!ofs || (std::filesystem::rename(tmp_filepath, _filepath, ec), ec)) {
+		SHLOG_W("Could not write the embedding cache to '" << _filepath << "'.");
+		return;
+	}
+
+	SHLOG_D("Saved " << entries.size() << " embeddings to '" << _filepath << "'.");
+}
+
+void EmbeddingCache::load() {
+	std::ifstream ifs(_filepath, std::ios::binary | std::ios::ate);
+	if (!ifs) return;  //< Nothing persisted yet
+
+	// Every length is checked against the rest of the file before anything is allocated
+	uint64_t remaining{ uint64_t(ifs.tellg()) };
+	ifs.seekg(0);
+
+	auto read_u32 = [&ifs, &remaining](uint32_t& v) {
+		if (remaining < sizeof(v)) return false;
+		ifs.read(reinterpret_cast<char*>(&v), sizeof(v));
+		remaining -= sizeof(v);
+		return bool(ifs);
+	};
+	auto read_bytes = [&ifs, &remaining](char* p, uint64_t len) {
+		if (remaining < len) return false;
+		ifs.read(p, len);
+		remaining -= len;
+		return bool(ifs);
+	};
+
+	std::vector<std::pair<std::string, std::vector<float>>> entries;
+	auto is_valid = [&]() {
+		uint32_t magic{ 0 };
+		uint32_t count{ 0 };
+		if (!read_u32(magic) || magic != CACHE_FILE_MAGIC || !read_u32(count)) return false;
+
+		for (uint32_t i = 0; i < count; ++i) {
+			uint32_t key_len{ 0 };
+			if (!read_u32(key_len) || key_len > CACHE_FILE_MAX_KEY_LEN) return false;
+			std::string key(key_len, '\0');
+			if (!read_bytes(key.data(), key_len)) return false;
+
+			uint32_t dim{ 0 };
+			if (!read_u32(dim) || (_dim != 0 && dim != _dim) || uint64_t(dim) * sizeof(float) > remaining) return false;
+			std::vector<float> embedding(dim);
+			if (!read_bytes(reinterpret_cast<char*>(embedding.data()), uint64_t(dim) * sizeof(float))) return false;
+
+			entries.emplace_back(std::move(key), std::move(embedding));
+		}
+		return remaining == 0;
+	};
+
+	if (!is_valid()) {
+		SHLOG_W("Ignoring the invalid embedding cache file '" << _filepath << "', starting with an empty cache.");
+		return;
+	}
+
+	std::lock_guard lck{ _lock };
+	for (auto&& [key, embedding] : entries) {
+		if (_items.count(key) > 0) continue;
+
+		_lru.push_front(key);
+		_items.emplace(std::move(key), std::make_pair(std::move(embedding), _lru.begin()));
+		evict_over_capacity();
+	}
+	SHLOG_D("Loaded " << _items.size() << " embeddings from '" << _filepath << "'.");
+}
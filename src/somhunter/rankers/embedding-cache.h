@@ -0,0 +1,93 @@
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2021 Frantisek Mejzlik <frankmejzlik@protonmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Vesely <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef EMBEDDING_CACHE_H_
+#define EMBEDDING_CACHE_H_
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+// ---
+#include "background-queue.h"
+
+namespace sh {
+
+/**
+ * LRU cache of the query embeddings keyed by a string (e.g. the normalized query text or a content hash).
+ *
+ * If a file is provided, the cache is loaded from it at the start and written
+ * back by `save`, so the embeddings survive the restarts. After every `SAVE_PERIOD`
+ * new entries, the save is also posted to the cache's own background thread (the
+ * storing thread may be e.g. the HTTP I/O one), so a crash loses only a few of them.
+ * An invalid file is ignored.
+ */
+class EmbeddingCache {
+public:
+	/** Number of the new entries after which the cache is written to the file in the background. */
+	static constexpr size_t SAVE_PERIOD{ 16 };
+
+	EmbeddingCache() = delete;
+	/** The embeddings loaded from the file must have `dim` floats (0 means any). */
+	EmbeddingCache(size_t capacity, size_t dim = 0, const std::string& filepath = "");
+
+	std::optional<std::vector<float>> find(const std::string& key);
+
+	void store(const std::string& key, std::vector<float> embedding);
+
+	/** Returns true if the key is cached (without touching its recency). */
+	bool contains(const std::string& key) const;
+
+	/** Writes the cache to the file (if any), replacing it at once. The lookups are blocked only while copying. */
+	void save() const;
+
+	size_t size() const;
+	size_t capacity() const { return _capacity; }
+
+private:
+	void load();
+
+	void evict_over_capacity();
+
+	const size_t _capacity;
+	const size_t _dim;
+	const std::string _filepath;
+
+	mutable std::mutex _lock;
+	/** Keys from the most recently used one. */
+	std::list<std::string> _lru;
+	std::unordered_map<std::string, std::pair<std::vector<float>, std::list<std::string>::iterator>> _items;
+	/** Number of the entries stored since the last save. */
+	mutable size_t _num_unsaved{ 0 };
+	/** True if a save is posted to `_saver` and not started yet. */
+	mutable bool _save_pending{ false };
+
+	/** Serializes the writers of the file. */
+	mutable std::mutex _save_lock;
+	/** Declared last, its destructor finishes the posted save before the members above are gone. */
+	std::unique_ptr<BackgroundQueue> _saver;
+};
+
+};  // namespace sh
+
+#endif  // EMBEDDING_CACHE_H_
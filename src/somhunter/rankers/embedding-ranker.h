@@ -24,6 +24,7 @@
 #include <cassert>
 #include <execution>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <map>
 #include <set>
@@ -39,6 +40,75 @@
 #include "utils.hpp"
 
 namespace sh {
+
+/** Number of rows one task of `inverse_score_rows` scans. */
+constexpr size_t INVERSE_SCORE_BLOCK_ROWS{ 4096 };
+
+/**
+ * Writes the halved cosine distances of `query_vec` to all the `num_rows` contiguous `dim`-dimensional
+ * (normalized) rows into `out`, i.e. the inverse scores \in [0.0F, 1.0F].
+ *
+ * The rows are scanned in parallel blocks by the 4-row `d_dot_rows` kernel.
+ */
+inline void inverse_score_rows(const float* query_vec, const float* rows, size_t num_rows, size_t dim, float* out) {
+	const size_t num_blocks{ (num_rows + INVERSE_SCORE_BLOCK_ROWS - 1) / INVERSE_SCORE_BLOCK_ROWS };
+
+	std::for_each(std::execution::par_unseq, ioterable<size_t>(0), ioterable<size_t>(num_blocks), [&](size_t b) {
+		const size_t from{ b * INVERSE_SCORE_BLOCK_ROWS };
+		const size_t count{ std::min(INVERSE_SCORE_BLOCK_ROWS, num_rows - from) };
+
+		float* block_out{ out + from };
+		d_dot_rows(rows + from * dim, count, dim, query_vec, block_out);
+		for (size_t i = 0; i < count; ++i) block_out[i] = (1.0F - block_out[i]) / 2.0F;
+	});
+}
+
+/**
+ * Serial version of `inverse_score_rows` for the background work.
+ *
+ * Runs on the calling thread only (keeping its priority) and polls `should_stop` between the blocks.
+ * Returns false if stopped (`out` is incomplete then).
+ */
+inline bool inverse_score_rows_serial(const float* query_vec, const float* rows, size_t num_rows, size_t dim,
+                                      float* out, const std::function<bool()>& should_stop) {
+	for (size_t from = 0; from < num_rows; from += INVERSE_SCORE_BLOCK_ROWS) {
+		if (should_stop()) return false;
+
+		const size_t count{ std::min(INVERSE_SCORE_BLOCK_ROWS, num_rows - from) };
+
+		float* block_out{ out + from };
+		d_dot_rows(rows + from * dim, count, dim, query_vec, block_out);
+		for (size_t i = 0; i < count; ++i) block_out[i] = (1.0F - block_out[i]) / 2.0F;
+	}
+	return true;
+}
+
+/**
+ * Multiplies each of `outs` by the inverse scores of the respective query to all the rows (as `inverse_score_rows`).
+ *
+ * All the queries are evaluated on one block of rows while it is in the cache, so the rows are read from the memory
+ * once for any number of queries.
+ */
+inline void multiply_inverse_scores(const std::vector<const float*>& queries, const float* rows, size_t num_rows,
+                                    size_t dim, const std::vector<float*>& outs) {
+	// The block fits the L2 cache
+	const size_t block_rows{ std::max<size_t>(4, (256 * 1024) / (dim * sizeof(float))) };
+	const size_t num_blocks{ (num_rows + block_rows - 1) / block_rows };
+
+	std::for_each(std::execution::par, ioterable<size_t>(0), ioterable<size_t>(num_blocks), [&](size_t b) {
+		const size_t from{ b * block_rows };
+		const size_t count{ std::min(block_rows, num_rows - from) };
+
+		std::vector<float> dots(count);
+		for (size_t j = 0; j < queries.size(); ++j) {
+			d_dot_rows(rows + from * dim, count, dim, queries[j], dots.data());
+
+			float* block_out{ outs[j] + from };
+			for (size_t i = 0; i < count; ++i) block_out[i] *= (1.0F - dots[i]) / 2.0F;
+		}
+	});
+}
+
 template <typename SpecificFrameFeatures>
 class EmbeddingRanker {
 public:
@@ -60,31 +130,9 @@ std::vector<float> EmbeddingRanker<SpecificFrameFeatures>::inverse_score_vector(
 template <typename SpecificFrameFeatures>
 std::vector<float> EmbeddingRanker<SpecificFrameFeatures>::inverse_score_vector(
     const float* query_vec, const SpecificFrameFeatures& features) const {
-	size_t target_dim{ features.dim() };
-
 	// Result is final score \in [0.0F, 1.0F] of `query_vec` as temporal query
-	std::vector<float> scores;
-	scores.resize(features.size());
-
-	// For all frames, comute the distance
-	std::for_each(std::execution::par_unseq, ioterable<FrameId>(0), ioterable<FrameId>(features.size()),
-	              [&, this](FrameId frame_ID) {
-		              const float* raw_frame_features = features.fv(frame_ID);
-
-		              // auto dist = utils::d_cos_normalized(query_vec, raw_frame_features, target_dim) / 2.0f;
-		              auto dist = d_cos_normalized(query_vec, raw_frame_features, target_dim) / 2.0F;
-
-		              scores[frame_ID] = dist;
-	              });
-	// Serial version
-	// for (FrameId frame_ID = 0; frame_ID < features.size(); ++frame_ID) {
-	//	const float* raw_frame_features = features.fv(frame_ID);
-
-	//	// auto dist = utils::d_cos_normalized(query_vec, raw_frame_features, target_dim) / 2.0f;
-	//	auto dist = d_cos_normalized(query_vec, raw_frame_features, target_dim) / 2.0F;
-
-	//	scores[frame_ID] = dist;
-	//}
+	std::vector<float> scores(features.size());
+	inverse_score_rows(query_vec, features.fv(0), features.size(), features.dim(), scores.data());
 
 	return scores;
 }
@@ -19,16 +19,28 @@
  * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <vector>
 
 #include "keyword-clip-ranker.h"
 
 using namespace sh;
 
-void KeywordClipRanker::rank_sentence_query(const std::string& sentence_query, ScoreModel& model,
+bool KeywordClipRanker::rank_sentence_query(const std::string& sentence_query, ScoreModel& model,
                                             const SecondaryFrameFeatures& _dataset_features, size_t temporal) {
-	if (sentence_query.empty()) return;
+	if (sentence_query.empty()) return false;
 
+	return _embedding_mode ? score_embedding(sentence_query, _dataset_features, model, temporal)
+	                       : fetch_distances(sentence_query, _dataset_features, model, temporal);
+}
+
+bool KeywordClipRanker::fetch_distances(const std::string& sentence_query,
+                                        const SecondaryFrameFeatures& _dataset_features, ScoreModel& model,
+                                        size_t temporal) {
 	const nlohmann::json headers;
 
 	nlohmann::json body;
@@ -43,21 +55,127 @@ void KeywordClipRanker::rank_sentence_query(const std::string& sentence_query, S
 	SHLOG_D("CLIP request took " << diff.count() << " [s]");
 	if (code != 200) {
 		SHLOG_E("Could not retrieve text query embedding from remote server!!! Return code: " << code);
-		return;
+		return false;
+	}
+
+	// The frames not returned get the maximal distance 2, the returned ones (1 - similarity)
+	//   (the scaling by powers of two is exact, so the returned ones get exactly (1 - similarity))
+	model.multiply(temporal, 2.0F);
+	float* scores{ model.temp_data(temporal) };
+	// Backwards so that the last occurrence of a repeated frame wins (it is applied only once)
+	std::vector<bool> applied(_dataset_features.size(), false);
+	for (size_t it = std::min(frame_ids.size(), similarities.size()); it-- > 0;) {
+		const size_t frame_ID{ size_t(frame_ids[it]) };
+		if (frame_ID >= _dataset_features.size() || applied[frame_ID]) continue;
+
+		applied[frame_ID] = true;
+		scores[frame_ID] *= (1.0F - similarities[it]) / 2.0F;
+	}
+
+	return true;
+}
+
+/** Collapses the whitespace (the cache key of the query). */
+static std::string normalize_query(const std::string& sentence_query) {
+	std::stringstream query_ss{ sentence_query };
+	std::string res;
+	for (std::string token; query_ss >> token;) {
+		if (!res.empty()) res += ' ';
+		res += token;
+	}
+	return res;
+}
+
+KeywordClipRanker::~KeywordClipRanker() noexcept {
+	std::vector<std::shared_future<std::vector<float>>> pending;
+	{
+		std::lock_guard lck{ _in_flight_lock };
+		for (auto&& [key, f] : _in_flight) pending.emplace_back(f);
+	}
+	for (auto&& f : pending) f.wait();
+
+	_embeddings.save();
+}
+
+void KeywordClipRanker::prefetch(const std::string& sentence_query) {
+	if (!_embedding_mode) return;
+
+	auto key{ normalize_query(sentence_query) };
+	if (key.empty()) return;
+
+	SHLOG_D("Prefetching the CLIP embedding of '" << key << "'...");
+	request_embedding(key);
+}
+
+std::shared_future<std::vector<float>> KeywordClipRanker::request_embedding(const std::string& key) {
+	std::lock_guard lck{ _in_flight_lock };
+
+	if (auto cached{ _embeddings.find(key) }; cached.has_value()) {
+		std::promise<std::vector<float>> ready;
+		ready.set_value(std::move(*cached));
+		return ready.get_future().share();
 	}
 
-	std::vector<float> scores(_dataset_features.size(), 2.0f);
+	auto it{ _in_flight.find(key) };
+	if (it != _in_flight.end()) return it->second;
+
+	auto promise{ std::make_shared<std::promise<std::vector<float>>>() };
+	auto res{ promise->get_future().share() };
+	_in_flight.emplace(key, res);
+
+	const auto& URL{ server_url + "/" + key };
+	_http.do_request_async(RequestType::GET, URL, {}, {}, [this, key, promise](HttpResponse&& response) {
+		std::vector<float> embedding;
+		if (!response.ok || response.code != 200) {
+			SHLOG_E("Could not retrieve text query embedding from remote server!!! Return code: " << response.code);
+		} else if (response.body.size() != _embedding_dim * sizeof(float)) {
+			// E.g. an error message, it must not get into the (persistent) cache
+			SHLOG_E("The CLIP embedding has " << response.body.size() << " bytes but the features have dimension "
+			                                  << _embedding_dim << "!");
+		} else {
+			embedding.resize(response.body.size() / sizeof(float));
+			std::memcpy(embedding.data(), response.body.data(), response.body.size());
+			_embeddings.store(key, embedding);
+		}
+
+		{
+			std::lock_guard lck{ _in_flight_lock };
+			_in_flight.erase(key);
+		}
+		promise->set_value(std::move(embedding));
+	});
 
-	std::for_each(std::execution::par_unseq, ioterable<size_t>(0), ioterable<size_t>(frame_ids.size()),
-	              [&, this](size_t it) {
-		              auto similarity = similarities[it];
+	return res;
+}
+
+bool KeywordClipRanker::score_embedding(const std::string& sentence_query,
+                                        const SecondaryFrameFeatures& _dataset_features, ScoreModel& model,
+                                        size_t temporal) {
+	auto start = std::chrono::high_resolution_clock::now();
+	auto query_vec{ request_embedding(normalize_query(sentence_query)).get() };
+	auto end = std::chrono::high_resolution_clock::now();
+	std::chrono::duration<double> diff = end - start;
+	SHLOG_D("CLIP embedding took " << diff.count() << " [s]");
+	if (query_vec.empty()) return false;
 
-		              auto frame_id = frame_ids[it];
-		              scores[frame_id] = 1.0F - similarity;
-	              });
+	if (query_vec.size() != _dataset_features.dim()) {
+		SHLOG_E("The CLIP embedding has dimension " << query_vec.size() << " but the features have "
+		                                            << _dataset_features.dim() << "!");
+		return false;
+	}
 
-	// Update the model
-	for (size_t i = 0; i < scores.size(); ++i) {
-		model.adjust(temporal, i, scores[i]);
+	// The service may not normalize it
+	float len{ std::sqrt(d_dot_normalized(query_vec.data(), query_vec.data(), query_vec.size())) };
+	if (len <= 0.0F) {
+		SHLOG_E("Zero CLIP embedding received!");
+		return false;
 	}
+	for (auto&& x : query_vec) x /= len;
+
+	// Cosine distance (i.e. 1 - similarity) the same as the "distances" mode gives
+	model.multiply(temporal, 2.0F);
+	multiply_inverse_scores({ query_vec.data() }, _dataset_features.fv(0), _dataset_features.size(),
+	                        _dataset_features.dim(), { model.temp_data(temporal) });
+
+	return true;
 }
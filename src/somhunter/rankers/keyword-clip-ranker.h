@@ -23,12 +23,16 @@
 
 #include <cassert>
 #include <fstream>
+#include <future>
 #include <iomanip>
 #include <map>
+#include <mutex>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 // ---
+#include "embedding-cache.h"
 #include "common.h"
 #include "embedding-ranker.h"
 #include "http.h"
@@ -37,14 +41,48 @@
 namespace sh {
 class KeywordClipRanker : public EmbeddingRanker<SecondaryFrameFeatures> {
 public:
-	inline KeywordClipRanker(const Settings& config) : server_url(config.remote_services.CLIP_query_to_vec.address) {}
+	inline KeywordClipRanker(const Settings& config)
+	    : server_url(config.remote_services.CLIP_query_to_vec.address),
+	      _embedding_mode{ config.remote_services.CLIP_query_to_vec.mode == "embedding" },
+	      _embedding_dim{ config.datasets.secondary_features._dim },
+	      _embeddings{ config.remote_services.CLIP_query_to_vec.cache_size, _embedding_dim,
+		               config.remote_services.CLIP_query_to_vec.cache_file } {}
 
-	void rank_sentence_query(const std::string& sentence_query, ScoreModel& model,
+	/** Waits for the prefetches and persists the embedding cache. */
+	~KeywordClipRanker() noexcept;
+
+	/** Requests the embedding of the query in the background ("embedding" mode only). */
+	void prefetch(const std::string& sentence_query);
+
+	/** Scores the `temporal` moment of the model, returns false if it was left untouched (e.g. the service failed). */
+	bool rank_sentence_query(const std::string& sentence_query, ScoreModel& model,
 	                         const SecondaryFrameFeatures& _dataset_features, size_t temporal);
 
 private:
-	Http _http;
+	/** Fetches the distances of all the frames from the service into the model ("distances" mode). */
+	bool fetch_distances(const std::string& sentence_query, const SecondaryFrameFeatures& _dataset_features,
+	                     ScoreModel& model, size_t temporal);
+
+	/** Fetches the text embedding and scores the frames locally into the model ("embedding" mode). */
+	bool score_embedding(const std::string& sentence_query, const SecondaryFrameFeatures& _dataset_features,
+	                     ScoreModel& model, size_t temporal);
+
+	/** Embedding of the query from the cache, the running request or a new one (empty on a failure). */
+	std::shared_future<std::vector<float>> request_embedding(const std::string& key);
+
 	std::string server_url;
+	/** If true, the service returns only the text embedding. */
+	bool _embedding_mode;
+	/** Dimension of the secondary features, the other embeddings are not cached. */
+	size_t _embedding_dim;
+
+	EmbeddingCache _embeddings;
+	std::mutex _in_flight_lock;
+	/** Embedding requests in progress keyed by the normalized query. */
+	std::unordered_map<std::string, std::shared_future<std::vector<float>>> _in_flight;
+
+	/** Declared last, its destructor waits for the callbacks using the members above. */
+	Http _http;
 };
 };  // namespace sh
 
@@ -0,0 +1,89 @@
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2021 Frantisek Mejzlik <frankmejzlik@protonmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Vesely <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "keyword-index.h"
+// ---
+#include <algorithm>
+// ---
+#include "keyword-ranker.h"
+
+using namespace sh;
+
+static bool starts_with(std::string_view s, std::string_view prefix) {
+	return s.size() >= prefix.size() && s.compare(0, prefix.size(), prefix) == 0;
+}
+
+KeywordIndex::KeywordIndex(const std::vector<Keyword>& keywords) {
+	for (auto&& kw : keywords) {
+		for (size_t j = 0; j < kw.synset_strs.size(); ++j) {
+			const auto& s{ kw.synset_strs[j] };
+
+			_entries.push_back(Entry{ kw.kw_ID, uint32_t(j), uint32_t(_text.size()), uint32_t(s.size()) });
+			_text += s;
+		}
+	}
+
+	_sorted.resize(_entries.size());
+	for (uint32_t i = 0; i < _sorted.size(); ++i) _sorted[i] = i;
+	std::sort(_sorted.begin(), _sorted.end(), [this](uint32_t a, uint32_t b) {
+		auto sa{ str(a) };
+		auto sb{ str(b) };
+		return sa < sb || (sa == sb && a < b);
+	});
+
+	for (uint32_t i = 0; i < _entries.size(); ++i)
+		for (uint32_t off = 1; off < _entries[i].len; ++off) _suffixes.push_back(Suffix{ i, off });
+	std::sort(_suffixes.begin(), _suffixes.end(),
+	          [this](const Suffix& a, const Suffix& b) { return str(a) < str(b); });
+
+	SHLOG_D("Keyword index built with " << _entries.size() << " strings and " << _suffixes.size() << " suffixes.");
+}
+
+KwSearchIds KeywordIndex::find(const std::string& search, size_t num_limit) const {
+	const std::string_view q{ search };
+	KwSearchIds res;
+
+	// Prefix matches: contiguous in the sorted strings
+	auto pb{ std::lower_bound(_sorted.begin(), _sorted.end(), q,
+		                      [this](uint32_t e, std::string_view val) { return str(e) < val; }) };
+	for (auto it = pb; it != _sorted.end() && res.size() < num_limit; ++it) {
+		if (!starts_with(str(*it), q)) break;
+		res.emplace_back(_entries[*it].kw_ID, _entries[*it].synset_idx);
+	}
+
+	if (res.size() >= num_limit) return res;
+
+	// Inner matches: contiguous in the suffix array, the prefix matches are already in
+	auto sb{ std::lower_bound(_suffixes.begin(), _suffixes.end(), q,
+		                      [this](const Suffix& s, std::string_view val) { return str(s) < val; }) };
+	std::vector<uint32_t> inner;
+	for (auto it = sb; it != _suffixes.end() && starts_with(str(*it), q); ++it) {
+		if (!starts_with(str(it->entry), q)) inner.push_back(it->entry);
+	}
+
+	std::sort(inner.begin(), inner.end());
+	inner.erase(std::unique(inner.begin(), inner.end()), inner.end());
+
+	for (size_t i = 0; i < inner.size() && res.size() < num_limit; ++i) {
+		res.emplace_back(_entries[inner[i]].kw_ID, _entries[inner[i]].synset_idx);
+	}
+
+	return res;
+}
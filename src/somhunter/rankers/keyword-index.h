@@ -0,0 +1,90 @@
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2021 Frantisek Mejzlik <frankmejzlik@protonmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Vesely <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef KEYWORD_INDEX_H_
+#define KEYWORD_INDEX_H_
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+// ---
+#include "common.h"
+
+namespace sh {
+
+struct Keyword;
+
+/**
+ * Index of the keyword strings for the prefix and substring lookups (autocomplete, query decoding).
+ *
+ * All the synset strings are stored in one buffer. The prefix lookups binary search the strings sorted
+ * lexicographically (a flattened trie); the substring lookups binary search the suffix array of all
+ * the non-zero offsets.
+ */
+class KeywordIndex {
+public:
+	KeywordIndex() = default;
+	/** Builds the index of all the synset strings of the `keywords`. */
+	KeywordIndex(const std::vector<Keyword>& keywords);
+
+	/**
+	 * Returns up to `num_limit` matches of `search`.
+	 *
+	 * The strings starting with `search` go first (lexicographically), then the ones containing it
+	 * (in the order of the keywords).
+	 */
+	KwSearchIds find(const std::string& search, size_t num_limit) const;
+
+	size_t size() const { return _entries.size(); }
+
+private:
+	struct Entry {
+		KeywordId kw_ID;
+		uint32_t synset_idx;
+		uint32_t begin;
+		uint32_t len;
+	};
+
+	struct Suffix {
+		uint32_t entry;
+		uint32_t offset;
+	};
+
+	std::string_view str(uint32_t entry) const {
+		const Entry& e{ _entries[entry] };
+		return std::string_view{ _text.data() + e.begin, e.len };
+	}
+
+	std::string_view str(const Suffix& s) const { return str(s.entry).substr(s.offset); }
+
+	/** All the strings concatenated. */
+	std::string _text;
+	/** The strings in the order of the keywords and their synsets. */
+	std::vector<Entry> _entries;
+	/** Indices into `_entries` sorted by the string. */
+	std::vector<uint32_t> _sorted;
+	/** All the proper suffixes sorted lexicographically. */
+	std::vector<Suffix> _suffixes;
+};
+
+};  // namespace sh
+
+#endif  // KEYWORD_INDEX_H_
@@ -22,6 +22,7 @@
 // ---
 #include <cmath>
 // ---
+#include "distances.hpp"
 #include "vector.hpp"
 
 using namespace sh;
@@ -217,39 +218,40 @@ FeatureMatrix KeywordRanker::parse_float_matrix(const std::string& filepath, siz
 	return result_features;
 }
 
-KwSearchIds KeywordRanker::find(const std::string& search, size_t num_limit) const {
-	KwSearchIds r;
-	KwSearchIds r2;
-
-	for (KeywordId i = 0; i < _keyword_ranker.size(); ++i)
-		for (size_t j = 0; j < _keyword_ranker[i].synset_strs.size(); ++j) {
-			auto kw = _keyword_ranker[i];
-
-			auto& s = kw.synset_strs[j];
-			auto f = s.find(search);
-
-			if (f == std::basic_string<char>::npos) continue;
+std::vector<float> KeywordRanker::parse_flat_float_matrix(const std::string& filepath, size_t row_dim,
+                                                          size_t begin_offset) {
+	// Open file for reading as binary from the end side
+	std::ifstream ifs(filepath, std::ios::binary | std::ios::ate);
 
-			if (f == 0u)
-				r.emplace_back(kw.kw_ID, j);
-			else
-				r2.emplace_back(kw.kw_ID, j);
-		}
+	// If failed to open file
+	if (!ifs) {
+		std::string msg{ "Error opening file: " + filepath };
+		SHLOG_E(msg);
+		throw std::runtime_error(msg);
+	}
 
-	std::sort(r.begin(), r.end(), [&](const KwSearchId& a, const KwSearchId& b) {
-		return _keyword_ranker[a.first].synset_strs[a.second] < _keyword_ranker[b.first].synset_strs[b.second];
-	});
+	// Compute size of the data part of the file
+	auto size = std::size_t(ifs.tellg());
+	if (size <= begin_offset) {
+		std::string msg{ "Empty file opened: " + filepath };
+		SHLOG_E(msg);
+		throw std::runtime_error(msg);
+	}
 
-	r.insert(r.end(), r2.begin(), r2.end());
+	// Only the whole rows are read
+	size_t row_byte_len = row_dim * sizeof(float);
+	size_t num_rows = (size - begin_offset) / row_byte_len;
 
-	KwSearchIds res;
-	for (size_t i = 0; i < num_limit; ++i) {
-		if (i >= r.size()) break;
+	std::vector<float> result_features(num_rows * row_dim);
 
-		res.emplace_back(r[i]);
+	ifs.seekg(begin_offset, std::ios::beg);
+	if (!ifs.read(reinterpret_cast<char*>(result_features.data()), num_rows * row_byte_len)) {
+		std::string msg{ "Error reading file: " + filepath };
+		SHLOG_E(msg);
+		throw std::runtime_error(msg);
 	}
 
-	return res;
+	return result_features;
 }
 
 StdVector<float> KeywordRanker::get_text_query_feature(const std::string& query_raw) {
@@ -292,7 +294,7 @@ std::vector<KeywordId> KeywordRanker::decode_keywords(const std::vector<std::str
 	std::vector<KeywordId> pos_one_query;
 	// Split tokens into temporal queries
 	for (const auto& kw_word : query) {
-		auto v = find(kw_word, 10);
+		auto v = find(kw_word, 1);
 
 		if (!v.empty()) pos_one_query.emplace_back(v.front().first);
 	}
@@ -300,47 +302,69 @@ std::vector<KeywordId> KeywordRanker::decode_keywords(const std::vector<std::str
 	return pos_one_query;
 }
 
-void KeywordRanker::rank_sentence_query(const std::string& sentence_query_raw, ScoreModel& model,
-                                        const PrimaryFrameFeatures& _dataset_features, size_t temporal) const {
+std::vector<float> KeywordRanker::embedding(const std::string& sentence_query_raw) const {
 	auto tokens{ tokenize_textual_query(sentence_query_raw) };
 
-	if (tokens.empty()) return;
+	if (tokens.empty()) return {};
 
 	auto decoded{ decode_keywords(tokens) };
 
-	// Get the most relevant images for this query
-	//  Distance is from [0, 1]
-	auto embedded{ embedd_text_queries(decoded) };
+	return embedd_text_queries(decoded);
+}
 
-	// Compute the scores for each frame for this query
-	std::vector<float> scores{ inverse_score_vector(embedded, _dataset_features) };
+bool KeywordRanker::rank_sentence_query(const std::string& sentence_query_raw, ScoreModel& model,
+                                        const PrimaryFrameFeatures& _dataset_features, size_t temporal) const {
+	auto embedded{ embedding(sentence_query_raw) };
+	if (embedded.empty()) return false;
 
-	// Update the model
-	for (size_t i = 0; i < scores.size(); ++i) {
-		model.adjust(temporal, i, scores[i]);
-	}
+	// Compute the scores for each frame straight into the model
+	multiply_inverse_scores({ embedded.data() }, _dataset_features.fv(0), _dataset_features.size(),
+	                        _dataset_features.dim(), { model.temp_data(temporal) });
+
+	return true;
 }
 
 StdVector<float> KeywordRanker::embedd_text_queries(const StdVector<KeywordId>& kws) const {
-	// Initialize zero vector
-	std::vector<float> score_vec(kw_pca_mean_vec.size(), 0.0f);
+	// The only temporary: the pre-PCA vector
+	thread_local std::vector<float> score_vec;
+	score_vec.assign(kw_features_bias_vec.begin(), kw_features_bias_vec.end());
+	float* sv = score_vec.data();
 
-	// Accumuate scores for given keywords
+	// Gather-sum the keyword rows (on top of the bias)
 	for (auto&& ID : kws) {
-		score_vec = math::vector::add(score_vec, kw_features[ID]);
+		const float* row = kw_features.data() + ID * _pre_PCA_dim;
+		for (size_t i = 0; i < _pre_PCA_dim; ++i) sv[i] += row[i];
 	}
 
-	// Add bias
-	score_vec = math::vector::add(score_vec, kw_features_bias_vec);
-
 	// Apply hyperbolic tangent function
-	std::transform(score_vec.begin(), score_vec.end(), score_vec.begin(),
-	               [](const float& score) { return std::tanh(score); });
+	float sq_len = 0.0F;
+	for (size_t i = 0; i < _pre_PCA_dim; ++i) {
+		sv[i] = std::tanh(sv[i]);
+		sq_len += sv[i] * sv[i];
+	}
+
+	if (sq_len <= 0.0F) {
+		SHLOG_E("Zero vector!");
+		return {};
+	}
+
+	// Normalize and center
+	const float inv_len = 1.0F / std::sqrt(sq_len);
+	for (size_t i = 0; i < _pre_PCA_dim; ++i) sv[i] = sv[i] * inv_len - kw_pca_mean_vec[i];
 
-	std::vector<float> sentence_vec =
-	    math::vector::mat_mult(kw_pca_mat, math::vector::sub(math::vector::normalize(score_vec), kw_pca_mean_vec));
+	// Project
+	std::vector<float> sentence_vec(_PCA_dim);
+	d_dot_rows(kw_pca_mat.data(), _PCA_dim, _pre_PCA_dim, sv, sentence_vec.data());
+
+	sq_len = 0.0F;
+	for (auto&& x : sentence_vec) sq_len += x * x;
+	if (sq_len <= 0.0F) {
+		SHLOG_E("Zero vector!");
+		return {};
+	}
 
-	sentence_vec = math::vector::normalize(sentence_vec);
+	const float inv_out_len = 1.0F / std::sqrt(sq_len);
+	for (auto&& x : sentence_vec) x *= inv_out_len;
 
 	return sentence_vec;
 }
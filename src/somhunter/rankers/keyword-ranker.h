@@ -35,6 +35,7 @@
 
 #include "dataset-frames.h"
 #include "embedding-ranker.h"
+#include "keyword-index.h"
 #include "scores.h"
 #include "settings.h"
 
@@ -51,10 +52,16 @@ struct Keyword {
 
 class KeywordRanker : public EmbeddingRanker<PrimaryFrameFeatures> {
 	std::vector<Keyword> _keyword_ranker;
-	FeatureMatrix kw_features;
+	size_t _pre_PCA_dim;
+	/** Keyword features, row-major (one `_pre_PCA_dim` row per keyword). */
+	std::vector<float> kw_features;
 	FeatureVector kw_features_bias_vec;
-	FeatureMatrix kw_pca_mat;
+	/** PCA projection, row-major (`_PCA_dim` rows of `_pre_PCA_dim`). */
+	std::vector<float> kw_pca_mat;
+	size_t _PCA_dim;
 	FeatureVector kw_pca_mean_vec;
+	/** Lookup index of the keyword strings. */
+	KeywordIndex _kw_index;
 
 public:
 	static std::vector<Keyword> parse_kw_classes_text_file(const std::string& filepath,
@@ -69,6 +76,9 @@ public:
 	 */
 	// @todo Make this template and inside some `Parsers` class
 	static FeatureMatrix parse_float_matrix(const std::string& filepath, size_t row_dim, size_t begin_offset = 0);
+	/** The same as `parse_float_matrix` but returns the matrix as one contiguous row-major array. */
+	static std::vector<float> parse_flat_float_matrix(const std::string& filepath, size_t row_dim,
+	                                                  size_t begin_offset = 0);
 	/**
 	 * FORMAT:
 	 *    Matrix of 4B floats:
@@ -80,17 +90,18 @@ public:
 
 	inline KeywordRanker(const Settings& config, const DatasetFrames& _dataset_frames)
 	    : _keyword_ranker(parse_kw_classes_text_file(config.datasets.primary_features.kws_file, _dataset_frames)),
+	      _pre_PCA_dim(config.datasets.primary_features.pre_PCA_features_dim),
 
-	      kw_features(parse_float_matrix(config.datasets.primary_features.kw_scores_mat_file,
-	                                     config.datasets.primary_features.pre_PCA_features_dim)),
+	      kw_features(parse_flat_float_matrix(config.datasets.primary_features.kw_scores_mat_file, _pre_PCA_dim)),
 	      kw_features_bias_vec(parse_float_vector(config.datasets.primary_features.kw_bias_vec_file,
 	                                              config.datasets.primary_features.pre_PCA_features_dim)),
 
-	      kw_pca_mat(parse_float_matrix(config.datasets.primary_features.kw_PCA_mat_file,
-	                                    config.datasets.primary_features.pre_PCA_features_dim)),
+	      kw_pca_mat(parse_flat_float_matrix(config.datasets.primary_features.kw_PCA_mat_file, _pre_PCA_dim)),
+	      _PCA_dim(kw_pca_mat.size() / _pre_PCA_dim),
 	      kw_pca_mean_vec(parse_float_vector(config.datasets.primary_features.kw_PCA_mean_vec_file,
-	                                         config.datasets.primary_features.pre_PCA_features_dim)) {
-		assert(kw_pca_mat.size() > 1);  // Make sure it's a matrix!
+	                                         config.datasets.primary_features.pre_PCA_features_dim)),
+	      _kw_index(_keyword_ranker) {
+		assert(_PCA_dim > 1);  // Make sure it's a matrix!
 
 		SHLOG_S("Keyword features loaded from '" << config.datasets.primary_features.kw_scores_mat_file
 		                                         << "' with dimension ("
@@ -127,9 +138,14 @@ public:
 		return _keyword_ranker[idx];
 	}
 
-	KwSearchIds find(const std::string& search, size_t num_limit) const;
+	/** Returns up to `num_limit` keywords matching `search` (prefix matches first), see `KeywordIndex::find`. */
+	KwSearchIds find(const std::string& search, size_t num_limit) const { return _kw_index.find(search, num_limit); }
 
-	void rank_sentence_query(const std::string& sentence_query_raw, ScoreModel& model,
+	/** Returns the (normalized) embedding of the query (empty if there is nothing to score). */
+	std::vector<float> embedding(const std::string& sentence_query_raw) const;
+
+	/** Scores the `temporal` moment of the model, returns false if it was left untouched (no tokens). */
+	bool rank_sentence_query(const std::string& sentence_query_raw, ScoreModel& model,
 	                         const PrimaryFrameFeatures& _dataset_features, size_t temporal) const;
 
 	// ----
@@ -0,0 +1,80 @@
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2021 Frantisek Mejzlik <frankmejzlik@protonmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Vesely <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "query-speculator.h"
+// ---
+#include "common.h"
+#include "os-utils.hpp"
+
+using namespace sh;
+
+QuerySpeculator::QuerySpeculator(std::chrono::milliseconds debounce, Job job)
+    : _debounce{ debounce }, _job{ std::move(job) }, _worker{ &QuerySpeculator::worker_loop, this } {}
+
+QuerySpeculator::~QuerySpeculator() noexcept {
+	{
+		std::lock_guard lck{ _lock };
+		_terminate = true;
+	}
+	_wakeup.notify_all();
+	_worker.join();
+}
+
+void QuerySpeculator::submit(const std::string& text) {
+	{
+		std::lock_guard lck{ _lock };
+		_pending = text;
+		_deadline = Clock::now() + _debounce;
+	}
+	_wakeup.notify_all();
+}
+
+bool QuerySpeculator::superseded() const {
+	std::lock_guard lck{ _lock };
+	return _terminate || _pending.has_value();
+}
+
+void QuerySpeculator::worker_loop() {
+	osutils::lower_thread_priority();
+
+	std::unique_lock lck{ _lock };
+	while (true) {
+		_wakeup.wait(lck, [this]() { return _terminate || _pending.has_value(); });
+		if (_terminate) return;
+
+		// Wait until the text stops changing (each submission moves the deadline)
+		while (!_terminate && _pending.has_value() && Clock::now() < _deadline) {
+			_wakeup.wait_until(lck, _deadline);
+		}
+		if (_terminate) return;
+		if (!_pending.has_value()) continue;
+
+		std::string text{ std::move(*_pending) };
+		_pending.reset();
+
+		lck.unlock();
+		try {
+			_job(text);
+		} catch (const std::exception& e) {
+			SHLOG_W("Speculative scoring of '" << text << "' failed: " << e.what());
+		}
+		lck.lock();
+	}
+}
@@ -0,0 +1,77 @@
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2021 Frantisek Mejzlik <frankmejzlik@protonmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Vesely <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef QUERY_SPECULATOR_H_
+#define QUERY_SPECULATOR_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+
+namespace sh {
+
+/**
+ * Runs the speculative scoring of the text being typed on a background thread.
+ *
+ * Each submitted text replaces the pending one and restarts the debounce
+ * period; the job is run only for the text that stayed unchanged that long.
+ * The worker thread runs with a lowered priority.
+ */
+class QuerySpeculator {
+public:
+	using Job = std::function<void(const std::string&)>;
+
+	QuerySpeculator() = delete;
+	QuerySpeculator(std::chrono::milliseconds debounce, Job job);
+	~QuerySpeculator() noexcept;
+
+	QuerySpeculator(const QuerySpeculator&) = delete;
+	QuerySpeculator& operator=(const QuerySpeculator&) = delete;
+
+	/** Schedules the job for the `text` after the debounce period (replacing the pending one). */
+	void submit(const std::string& text);
+
+	/** True if the running job is obsolete (a newer text is pending or the speculator is being destroyed). */
+	bool superseded() const;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	void worker_loop();
+
+	const std::chrono::milliseconds _debounce;
+	const Job _job;
+
+	mutable std::mutex _lock;
+	std::condition_variable _wakeup;
+	std::optional<std::string> _pending;
+	Clock::time_point _deadline;
+	bool _terminate{ false };
+
+	std::thread _worker;
+};
+
+};  // namespace sh
+
+#endif  // QUERY_SPECULATOR_H_
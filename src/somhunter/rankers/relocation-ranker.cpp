@@ -29,11 +29,7 @@ void RelocationRanker::score(const RelocationQuery& query, ScoreModel& model, si
                              const PrimaryFrameFeatures& _dataset_features) const {
 	if (query == IMAGE_ID_ERR_VAL) return;
 
-	// Compute inverse scores in for the example query
-	auto scores{ inverse_score_vector(_dataset_features.fv(query), _dataset_features) };
-
-	// Update the model
-	for (size_t i = 0; i < scores.size(); ++i) {
-		model.adjust(temporal, i, scores[i]);
-	}
+	// Compute inverse scores for the example query straight into the model
+	multiply_inverse_scores({ _dataset_features.fv(query) }, _dataset_features.fv(0), _dataset_features.size(),
+	                        _dataset_features.dim(), { model.temp_data(temporal) });
 }
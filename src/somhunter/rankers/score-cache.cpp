@@ -0,0 +1,237 @@
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2021 Frantisek Mejzlik <frankmejzlik@protonmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Vesely <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "score-cache.h"
+// ---
+#include <cstring>
+#include <optional>
+// ---
+#include "common.h"
+
+using namespace sh;
+
+/** Converts to IEEE 754 half precision (round to nearest even). */
+static uint16_t float_to_half(float f) {
+	uint32_t x;
+	std::memcpy(&x, &f, sizeof(x));
+
+	const uint32_t sign = (x >> 16) & 0x8000U;
+	const uint32_t exp = (x >> 23) & 0xFFU;
+	uint32_t mant = x & 0x7FFFFFU;
+
+	// NaN & Inf
+	if (exp == 0xFFU) return uint16_t(sign | 0x7C00U | (mant != 0 ? 0x200U : 0U));
+
+	int32_t e = int32_t(exp) - 127 + 15;
+	// Overflow
+	if (e >= 0x1F) return uint16_t(sign | 0x7C00U);
+
+	// Subnormals (or zero)
+	if (e <= 0) {
+		if (e < -10) return uint16_t(sign);
+		mant |= 0x800000U;
+		const uint32_t shift = uint32_t(14 - e);
+		uint32_t h = mant >> shift;
+		const uint32_t rem = mant & ((1U << shift) - 1U);
+		const uint32_t half = 1U << (shift - 1U);
+		if (rem > half || (rem == half && (h & 1U))) ++h;
+		return uint16_t(sign | h);
+	}
+
+	uint32_t h = (uint32_t(e) << 10) | (mant >> 13);
+	const uint32_t rem = mant & 0x1FFFU;
+	if (rem > 0x1000U || (rem == 0x1000U && (h & 1U))) ++h;  //< May carry to the exponent, that is correct
+	return uint16_t(sign | h);
+}
+
+static float half_to_float(uint16_t h) {
+	const uint32_t sign = uint32_t(h & 0x8000U) << 16;
+	uint32_t exp = (h >> 10) & 0x1FU;
+	uint32_t mant = h & 0x3FFU;
+
+	uint32_t x;
+	if (exp == 0x1FU) {
+		x = sign | 0x7F800000U | (mant << 13);
+	} else if (exp != 0) {
+		x = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+	} else if (mant == 0) {
+		x = sign;
+	} else {
+		// Subnormal, normalize it
+		exp = 127 - 15 + 1;
+		while ((mant & 0x400U) == 0) {
+			mant <<= 1;
+			--exp;
+		}
+		x = sign | (exp << 23) | ((mant & 0x3FFU) << 13);
+	}
+
+	float f;
+	std::memcpy(&f, &x, sizeof(f));
+	return f;
+}
+
+bool ScoreCache::find(const std::string& key, float* out, size_t size) {
+	std::lock_guard lck{ _lock };
+	return find_locked(key, out, size);
+}
+
+bool ScoreCache::find_locked(const std::string& key, float* out, size_t size) {
+	auto it{ _items.find(key) };
+	if (it == _items.end() || it->second.first.size() != size) {
+		++_num_misses;
+		return false;
+	}
+
+	const Item& item{ it->second.first };
+	if (item.f32.empty()) {
+		for (size_t i = 0; i < size; ++i) out[i] = half_to_float(item.f16[i]);
+	} else {
+		std::copy(item.f32.begin(), item.f32.end(), out);
+	}
+
+	_lru.splice(_lru.begin(), _lru, it->second.second);
+	++_num_hits;
+	return true;
+}
+
+void ScoreCache::store(const std::string& key, const float* scores, size_t size) {
+	Item item;
+	if (_fp16) {
+		item.f16.resize(size);
+		for (size_t i = 0; i < size; ++i) item.f16[i] = float_to_half(scores[i]);
+	} else {
+		item.f32.assign(scores, scores + size);
+	}
+
+	const size_t item_size{ item.mem_size() };
+	if (item_size > _max_bytes) return;
+
+	std::lock_guard lck{ _lock };
+
+	auto it{ _items.find(key) };
+	if (it != _items.end()) {
+		_size -= it->second.first.mem_size();
+		_lru.erase(it->second.second);
+		_items.erase(it);
+	}
+
+	_lru.push_front(key);
+	_items.emplace(key, std::make_pair(std::move(item), _lru.begin()));
+	_size += item_size;
+
+	evict_over_budget();
+}
+
+bool ScoreCache::contains(const std::string& key) const {
+	std::lock_guard lck{ _lock };
+	return _items.count(key) > 0 || _in_flight.count(key) > 0;
+}
+
+void ScoreCache::clear() {
+	std::lock_guard lck{ _lock };
+	_lru.clear();
+	_items.clear();
+	_size = 0;
+}
+
+ScoreCache::Stats ScoreCache::stats() const {
+	std::lock_guard lck{ _lock };
+	return Stats{ _items.size(), _size, _num_hits, _num_misses, _num_coalesced };
+}
+
+ScoreCache::Lookup ScoreCache::find_or_compute(const std::string& key, float* out, size_t size,
+                                               const Compute& compute) {
+	std::promise<std::shared_ptr<const std::vector<float>>> promise;
+	std::optional<Flight> flight;
+	{
+		// One critical section, otherwise a computation finishing in between would run again
+		std::lock_guard lck{ _lock };
+		if (find_locked(key, out, size)) return Lookup::Shared;
+
+		auto it{ _in_flight.find(key) };
+		if (it != _in_flight.end()) {
+			flight = it->second.result;
+			++it->second.num_waiters;
+			++_num_coalesced;
+		} else {
+			_in_flight.emplace(key, InFlight{ promise.get_future().share() });
+		}
+	}
+
+	// Someone else computes it
+	if (flight.has_value()) {
+		auto res{ flight->get() };
+		if (res != nullptr && res->size() == size) {
+			std::copy(res->begin(), res->end(), out);
+			return Lookup::Shared;
+		}
+
+		// They failed, try it on our own
+		const float* scores{ compute() };
+		if (scores == nullptr) return Lookup::Failed;
+
+		store(key, scores, size);
+		return Lookup::Computed;
+	}
+
+	// Once erased, the new callers find the stored vector instead
+	auto finish = [&](const float* scores) {
+		size_t num_waiters{ 0 };
+		{
+			std::lock_guard lck{ _lock };
+			auto it{ _in_flight.find(key) };
+			num_waiters = it->second.num_waiters;
+			_in_flight.erase(it);
+		}
+
+		// Usually nobody waits, do not copy the whole vector then
+		if (scores == nullptr || num_waiters == 0)
+			promise.set_value(nullptr);
+		else
+			promise.set_value(std::make_shared<const std::vector<float>>(scores, scores + size));
+	};
+
+	const float* scores{ nullptr };
+	try {
+		scores = compute();
+	} catch (...) {
+		finish(nullptr);
+		throw;
+	}
+
+	if (scores == nullptr) {
+		finish(nullptr);
+		return Lookup::Failed;
+	}
+
+	store(key, scores, size);
+	finish(scores);
+	return Lookup::Computed;
+}
+
+void ScoreCache::evict_over_budget() {
+	while (_size > _max_bytes && !_lru.empty()) {
+		auto it{ _items.find(_lru.back()) };
+		_size -= it->second.first.mem_size();
+		_items.erase(it);
+		_lru.pop_back();
+	}
+}
@@ -0,0 +1,137 @@
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2021 Frantisek Mejzlik <frankmejzlik@protonmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Vesely <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SCORE_CACHE_H_
+#define SCORE_CACHE_H_
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace sh {
+
+/**
+ * Process-wide cache of the per-moment inverse score vectors.
+ *
+ * The key identifies the ranker, the feature set and the normalized query
+ * (e.g. "w2vv/primary/dog park"). The total size of the stored vectors is
+ * bounded, the least recently used ones are dropped first. The vectors may be
+ * stored as IEEE half floats to fit twice as many.
+ *
+ * Concurrent misses of the same key are coalesced (single-flight): only the
+ * first caller computes the vector, the others wait for it and share it.
+ */
+class ScoreCache {
+public:
+	struct Stats {
+		size_t num_entries;
+		size_t mem_size;
+		size_t num_hits;
+		size_t num_misses;
+		/** Number of the misses served by a computation of another caller. */
+		size_t num_coalesced;
+	};
+
+	/** Outcome of `find_or_compute`. */
+	enum class Lookup {
+		/** The vector was copied to the output (from the cache or from a concurrent computation). */
+		Shared,
+		/** This caller computed the vector. */
+		Computed,
+		/** The computation did not produce any vector. */
+		Failed
+	};
+
+	/** Computes the vector of the key, returns the pointer to it (valid until the call returns) or nullptr. */
+	using Compute = std::function<const float*()>;
+
+	ScoreCache() = delete;
+	ScoreCache(size_t max_bytes, bool fp16) : _max_bytes{ max_bytes }, _fp16{ fp16 } {};
+
+	ScoreCache(const ScoreCache&) = delete;
+	ScoreCache& operator=(const ScoreCache&) = delete;
+
+	/** Copies the vector stored under `key` into `out` (of `size` floats), returns false on a miss. */
+	bool find(const std::string& key, float* out, size_t size);
+
+	/** Stores a copy of the `size` floats under `key`, evicting the old ones if over the budget. */
+	void store(const std::string& key, const float* scores, size_t size);
+
+	/**
+	 * Copies the vector of `key` into `out` if cached or being computed by another caller (waits for it).
+	 * Otherwise runs `compute` and stores its result; `out` is not written then.
+	 */
+	Lookup find_or_compute(const std::string& key, float* out, size_t size, const Compute& compute);
+
+	/** Returns true if the vector of `key` is cached or being computed. */
+	bool contains(const std::string& key) const;
+
+	void clear();
+
+	Stats stats() const;
+
+private:
+	struct Item {
+		std::vector<float> f32;
+		std::vector<uint16_t> f16;
+
+		size_t size() const { return f32.empty() ? f16.size() : f32.size(); }
+		size_t mem_size() const { return f32.size() * sizeof(float) + f16.size() * sizeof(uint16_t); }
+	};
+
+	/** `find` with the `_lock` held. */
+	bool find_locked(const std::string& key, float* out, size_t size);
+
+	void evict_over_budget();
+
+	/** Result of an in-flight computation, nullptr if it failed (or nobody waited for it). */
+	using Flight = std::shared_future<std::shared_ptr<const std::vector<float>>>;
+
+	struct InFlight {
+		Flight result;
+		/** The result is copied out of the computing caller's buffer only for the waiters. */
+		size_t num_waiters{ 0 };
+	};
+
+	const size_t _max_bytes;
+	const bool _fp16;
+
+	mutable std::mutex _lock;
+	/** Keys from the most recently used one. */
+	std::list<std::string> _lru;
+	std::unordered_map<std::string, std::pair<Item, std::list<std::string>::iterator>> _items;
+	size_t _size{ 0 };
+	/** Computations in progress. */
+	std::unordered_map<std::string, InFlight> _in_flight;
+
+	size_t _num_hits{ 0 };
+	size_t _num_misses{ 0 };
+	size_t _num_coalesced{ 0 };
+};
+
+};  // namespace sh
+
+#endif  // SCORE_CACHE_H_
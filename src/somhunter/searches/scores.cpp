@@ -26,6 +26,7 @@
 #include <execution>
 #include <functional>
 #include <map>
+#include <numeric>
 #include <random>
 #include <set>
 #include <thread>
@@ -88,9 +89,9 @@ bool ScoreModel::operator==(const ScoreModel& other) const { return (_scores ==
 void ScoreModel::reset(float val) {
 	invalidate_cache();
 
-	for (auto& i : _scores) i = val;
+	std::fill(std::execution::par_unseq, _scores.begin(), _scores.end(), val);
 	for (auto&& moment_score : _temporal_scores) {
-		for (auto& ms : moment_score) ms = val;
+		std::fill(std::execution::par_unseq, moment_score.begin(), moment_score.end(), val);
 	}
 }
 
@@ -112,6 +113,45 @@ float ScoreModel::set(FrameId i, float prob) {
 	return _scores[i] = prob;
 }
 
+void ScoreModel::multiply(size_t temp, const float* factors) {
+	invalidate_cache();
+
+	bulk_multiply(_temporal_scores[temp].data(), factors, _temporal_scores[temp].size());
+}
+
+void ScoreModel::multiply(size_t temp, float factor) {
+	invalidate_cache();
+
+	bulk_multiply(_temporal_scores[temp].data(), factor, _temporal_scores[temp].size());
+}
+
+void ScoreModel::set(size_t temp, const float* vals) {
+	invalidate_cache();
+
+	bulk_set(_temporal_scores[temp].data(), vals, _temporal_scores[temp].size());
+}
+
+void ScoreModel::bulk_multiply(float* dst, const float* factors, size_t size) {
+	std::transform(std::execution::par_unseq, dst, dst + size, factors, dst, std::multiplies<float>{});
+}
+
+void ScoreModel::bulk_multiply(float* dst, float factor, size_t size) {
+	std::transform(std::execution::par_unseq, dst, dst + size, dst, [factor](float x) { return x * factor; });
+}
+
+void ScoreModel::bulk_set(float* dst, const float* vals, size_t size) {
+	std::copy(std::execution::par_unseq, vals, vals + size, dst);
+}
+
+void ScoreModel::bulk_multiply_min(float* dst, const float* factors, const float* src, const uint8_t* spans,
+                                   size_t size) {
+	std::for_each(std::execution::par_unseq, ioterable<size_t>(0), ioterable<size_t>(size), [=](size_t j) {
+		float min = 1;
+		for (size_t k = 1; k <= spans[j]; ++k) min = std::min(min, src[j + k]);
+		dst[j] = factors[j] * min;
+	});
+}
+
 std::vector<FrameId> ScoreModel::top_n_with_context(const DatasetFrames& _dataset_frames, size_t _size,
                                                     size_t from_vid_limit, size_t from_shot_limit) const {
 	// Is this cached
@@ -327,41 +367,44 @@ void ScoreModel::apply_bayes(std::set<FrameId> likes, const std::set<FrameId>& s
 
 void ScoreModel::apply_temporals(size_t depth, const DatasetFrames& _dataset_frames, const float power) {
 	if (depth == 0) return;
+	invalidate_cache();
 
 	depth = std::min(depth, _temporal_scores.size());
+	const size_t size{ _scores.size() };
 
 	// Last level copy to main scores
-	for (size_t j = 0; j < _scores.size(); ++j) {
-		_scores[j] = _temporal_scores[depth - 1][j];
-	}
+	bulk_set(_scores.data(), _temporal_scores[depth - 1].data(), size);
 
 	// At this point the _temporal_scores contains proportional inverse scores
 	// Other levels multiply with minimal inverse scores from window
-	for (long i = depth - 2; i >= 0; --i) {
-		for (size_t j = 0; j < _scores.size(); ++j) {
-			auto img_it = _dataset_frames.get_frame_it(j);
-			VideoId vid_ID = img_it->video_ID;
-
-			// Select minimal proportional inverse score
-			float min = 1;
-			for (size_t k = 1; k < KW_TEMPORAL_SPAN && j + k < _scores.size(); ++k) {
-				img_it++;
-				if (img_it->video_ID != vid_ID) break;
-				min = std::min(min, _scores[j + k]);
+	if (depth > 1) {
+		// Number of the following frames of the same video in the window
+		std::vector<uint8_t> spans(size);
+		std::for_each(std::execution::par_unseq, ioterable<size_t>(0), ioterable<size_t>(size), [&](size_t j) {
+			VideoId vid_ID{ _dataset_frames.get_frame(j).video_ID };
+
+			uint8_t span{ 0 };
+			for (size_t k = 1; k < KW_TEMPORAL_SPAN && j + k < size; ++k) {
+				if (_dataset_frames.get_frame(j + k).video_ID != vid_ID) break;
+				++span;
 			}
-			_scores[j] = _temporal_scores[i][j] * min;
+			spans[j] = span;
+		});
+
+		std::vector<float> prev(size);
+		for (long i = depth - 2; i >= 0; --i) {
+			std::swap(prev, _scores);
+			bulk_multiply_min(_scores.data(), _temporal_scores[i].data(), prev.data(), spans.data(), size);
 		}
 	}
 
 	// Apply exponential
-	for (size_t j = 0; j < _scores.size(); ++j) {
-		_scores[j] = std::exp(_scores[j] * -power);
-	}
+	auto apply_exp = [power](float x) { return std::exp(x * -power); };
+	std::transform(std::execution::par_unseq, _scores.begin(), _scores.end(), _scores.begin(), apply_exp);
 
 	for (size_t i = 0; i < depth; ++i) {
-		for (size_t j = 0; j < _scores.size(); ++j) {
-			_temporal_scores[i][j] = std::exp(_temporal_scores[i][j] * -power);
-		}
+		std::transform(std::execution::par_unseq, _temporal_scores[i].begin(), _temporal_scores[i].end(),
+		               _temporal_scores[i].begin(), apply_exp);
 	}
 }
 
@@ -373,23 +416,20 @@ void ScoreModel::normalize(size_t depth) {
 }
 
 void ScoreModel::normalize(float* scores, size_t size) {
-	float smax = 0;
+	invalidate_cache();
 
-	for (FrameId ii = 0; ii < size; ++ii)
-		if (scores[ii] > smax) smax = scores[ii];
+	float smax = std::reduce(std::execution::par_unseq, scores, scores + size, 0.0F,
+	                         [](float a, float b) { return std::max(a, b); });
 
 	if (smax < MINIMAL_SCORE) {
 		SHLOG_E("all images have negligible score!");
 		smax = MINIMAL_SCORE;
 	}
 
-	size_t _size = 0;
-	for (FrameId ii = 0; ii < size; ++ii) {
-		if (_mask[ii]) {
-			scores[ii] /= smax;
-			if (scores[ii] < MINIMAL_SCORE) ++_size, scores[ii] = MINIMAL_SCORE;
-		}
-	}
+	// (the mask is a bitset, it is read per frame)
+	std::for_each(std::execution::par, ioterable<size_t>(0), ioterable<size_t>(size), [&](size_t ii) {
+		if (_mask[ii]) scores[ii] = std::max(scores[ii] / smax, MINIMAL_SCORE);
+	});
 }
 
 size_t ScoreModel::frame_rank(FrameId i) const {
@@ -21,6 +21,7 @@
 #ifndef scores_h
 #define scores_h
 
+#include <cstdint>
 #include <map>
 #include <set>
 #include <vector>
@@ -82,6 +83,36 @@ public:
 
 	const float* temp(size_t temp) const { return _temporal_scores[temp].data(); }
 
+	/** Mutable pointer to the temporal part `temp` for the rankers writing it in bulk (invalidates the cache). */
+	float* temp_data(size_t temp) {
+		invalidate_cache();
+		return _temporal_scores[temp].data();
+	}
+
+	// ***
+	// Bulk operations (parallel & vectorized, the cache is invalidated once)
+
+	/** Multiplies the temporal part `temp` by `factors` (one per frame). */
+	void multiply(size_t temp, const float* factors);
+	/** Multiplies the temporal part `temp` by `factor`. */
+	void multiply(size_t temp, float factor);
+	/** Sets the temporal part `temp` to `vals` (one per frame). */
+	void set(size_t temp, const float* vals);
+
+	/** `dst[i] *= factors[i]` */
+	static void bulk_multiply(float* dst, const float* factors, size_t size);
+	/** `dst[i] *= factor` */
+	static void bulk_multiply(float* dst, float factor, size_t size);
+	/** `dst[i] = vals[i]` */
+	static void bulk_set(float* dst, const float* vals, size_t size);
+	/**
+	 * `dst[i] = factors[i] * min(1, src[i + 1], ..., src[i + spans[i]])`
+	 *
+	 * The fused step of the temporal queries (`dst` may not alias `src`).
+	 */
+	static void bulk_multiply_min(float* dst, const float* factors, const float* src, const uint8_t* spans,
+	                              size_t size);
+
 	/** Returns number of scores stored. */
 	size_t size() const { return _scores.size(); }
 
@@ -26,24 +26,27 @@
 using namespace sh;
 
 UserContext::UserContext(const Settings& settings, const std::string& username, const DatasetFrames* p_dataset_frames,
-                         const PrimaryFrameFeatures* p_dataset_features)
+                         const PrimaryFrameFeatures* p_dataset_features, SomScheduler* p_som_scheduler)
     : _p_dataset_frames{ p_dataset_frames },
       _p_dataset_features{ p_dataset_features },
       ctx(0, settings, *_p_dataset_frames),
       _username(username),
       _eval_server{ settings.eval_server },
       _logger(settings.eval_server, this, &_eval_server),
-      _async_SOM(settings, SOM_DISPLAY_GRID_WIDTH, SOM_DISPLAY_GRID_HEIGHT, *p_dataset_features, ctx.scores),
+      _async_SOM(settings, p_som_scheduler, SomScheduler::Priority::MainDisplay, SOM_DISPLAY_GRID_WIDTH,
+                 SOM_DISPLAY_GRID_HEIGHT, *p_dataset_features, ctx.scores),
+      _som_history{ settings.soms.history_max_mb * 1024 * 1024 },
       _force_result_log{ false } {
 	SHLOG_D("Triggering main SOM worker");
-	_async_SOM.start_work(*_p_dataset_features, ctx.scores, ctx.scores.v());
+	_async_SOM.start_work(ctx.scores, ctx.scores.v());
 
 	// Temporal query SOMs
 	for (size_t i = 0; i < MAX_TEMPORAL_SIZE; ++i) {
 		SHLOG_D("Triggering " << i << " SOM worker");
-		_temp_async_SOM.push_back(std::make_unique<AsyncSom>(settings, RELOCATION_GRID_WIDTH, RELOCATION_GRID_HEIGHT,
-		                                                     *_p_dataset_features, ctx.scores));
-		_temp_async_SOM[i]->start_work(*_p_dataset_features, ctx.scores, ctx.scores.temp(i));
+		_temp_async_SOM.push_back(std::make_unique<AsyncSom>(settings, p_som_scheduler,
+		                                                     SomScheduler::Priority::Relocation, RELOCATION_GRID_WIDTH,
+		                                                     RELOCATION_GRID_HEIGHT, *_p_dataset_features, ctx.scores));
+		_temp_async_SOM[i]->start_work(ctx.scores, ctx.scores.temp(i));
 	}
 
 	/* ***
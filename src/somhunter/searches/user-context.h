@@ -32,6 +32,8 @@
 #include "eval-server-client.h"
 #include "logger.h"
 #include "search-context.h"
+#include "som-history.h"
+#include "som-scheduler.h"
 
 namespace sh {
 /** Represents exactly one state of ONE user that uses this core. */
@@ -39,7 +41,7 @@ class UserContext {
 public:
 	UserContext() = delete;
 	UserContext(const Settings& settings, const std::string& username, const DatasetFrames* p_dataset_frames,
-	            const PrimaryFrameFeatures* p_dataset_features);
+	            const PrimaryFrameFeatures* p_dataset_features, SomScheduler* p_som_scheduler);
 
 	const std::string& get_username() const { return _username; };
 	const DatasetFrames* get_frames() const { return _p_dataset_frames; };
@@ -57,6 +59,7 @@ public:
 
 		_history.clear();
 		//_history.emplace_back(ctx);
+		_som_history.clear();
 
 		_videos_seen.clear();
 	}
@@ -84,6 +87,8 @@ public:  //< This is temporary, until we support multiple users
 
 	AsyncSom _async_SOM;
 	std::vector<std::unique_ptr<AsyncSom>> _temp_async_SOM;
+	/** SOM maps of the contexts in the `_history`. */
+	SomHistory _som_history;
 
 	/** Frames selected as important. */
 	BookmarksCont _bookmarks;
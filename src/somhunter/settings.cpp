@@ -199,6 +199,58 @@ PresentationViewsSettings parse_presentation_views_settings(const json& json) {
 	};
 }
 
+SomsSettings parse_soms_settings(const json& json) {
+	SomsSettings res{ // .num_workers
+		              optional_value_or<std::size_t>(json, "num_workers", 0),
+		              // .num_iterations
+		              optional_value_or<std::size_t>(json, "num_iterations", SOM_ITERS),
+		              // .time_budget_ms
+		              optional_value_or<std::size_t>(json, "time_budget_ms", 0),
+		              // .training_mode
+		              optional_value_or<std::string>(json, "training_mode", "online"),
+		              // .batch_size
+		              optional_value_or<std::size_t>(json, "batch_size", SOM_BATCH_SIZE),
+		              // .num_epochs
+		              optional_value_or<std::size_t>(json, "num_epochs", SOM_EPOCHS),
+		              // .quant_error_sample_size
+		              optional_value_or<std::size_t>(json, "quant_error_sample_size", 0),
+		              // .warm_start
+		              optional_value_or<bool>(json, "warm_start", false),
+		              // .warm_start_top_k
+		              optional_value_or<std::size_t>(json, "warm_start_top_k", 1000),
+		              // .warm_start_max_divergence
+		              optional_value_or<float>(json, "warm_start_max_divergence", 0.5F),
+		              // .warm_start_min_fraction
+		              optional_value_or<float>(json, "warm_start_min_fraction", 0.1F),
+		              // .zoom_levels
+		              optional_value_or<bool>(json, "zoom_levels", false),
+		              // .zoom_num_iterations
+		              optional_value_or<std::size_t>(json, "zoom_num_iterations", SOM_ITERS / 6),
+		              // .zoom_time_budget_ms
+		              optional_value_or<std::size_t>(json, "zoom_time_budget_ms", 200),
+		              // .history_max_mb
+		              optional_value_or<std::size_t>(json, "history_max_mb", 256)
+	};
+
+	if (res.training_mode != "online" && res.training_mode != "batch") {
+		SHLOG_E_THROW("Uknown SOM training mode: " + res.training_mode);
+	}
+
+	return res;
+}
+
+ScoreCacheSettings parse_score_cache_settings(const json& json) {
+	return ScoreCacheSettings{ // .max_mb
+		                       optional_value_or<std::size_t>(json, "max_mb", 0),
+		                       // .fp16
+		                       optional_value_or<bool>(json, "fp16", false),
+		                       // .speculative
+		                       optional_value_or<bool>(json, "speculative", false),
+		                       // .speculative_debounce_ms
+		                       optional_value_or<std::size_t>(json, "speculative_debounce_ms", 300)
+	};
+}
+
 LoggerSettings parse_logger_settings(const json& /*json*/) {
 	return LoggerSettings{
 		// ... No settings as of yet
@@ -206,9 +258,23 @@ LoggerSettings parse_logger_settings(const json& /*json*/) {
 }
 
 RemoteServicesSettings::ClipQueryToVec parse_clip_settings(const json& json) {
-	return RemoteServicesSettings::ClipQueryToVec{ // .address
-		                                           optional_value_or<std::string>(json, "address", "")
+	RemoteServicesSettings::ClipQueryToVec res{ // .address
+		                                        optional_value_or<std::string>(json, "address", ""),
+		                                        // .mode
+		                                        optional_value_or<std::string>(json, "mode", "distances"),
+		                                        // .cache_size
+		                                        optional_value_or<std::size_t>(json, "cache_size", 1024),
+		                                        // .cache_file
+		                                        optional_value_or<std::string>(json, "cache_file", ""),
+		                                        // .prefetch
+		                                        optional_value_or<bool>(json, "prefetch", false)
 	};
+
+	if (res.mode != "distances" && res.mode != "embedding") {
+		SHLOG_E_THROW("Uknown CLIP service mode: " + res.mode);
+	}
+
+	return res;
 }
 RemoteServicesSettings::MediaServer parse_media_server_settings(const json& json) {
 	return RemoteServicesSettings::MediaServer{ // .address
@@ -238,7 +304,20 @@ ModelsSettings parse_model_settings(const json& json) {
 		optional_value_or<std::string>(json, "model_ResNext_file", ""),
 		// .model_ResNext_SHA256
 		optional_value_or<std::string>(json, "model_ResNext_SHA256", ""),
-
+		// .model_ResNet_int8_file
+		optional_value_or<std::string>(json, "model_ResNet_int8_file", ""),
+		// .model_ResNext_int8_file
+		optional_value_or<std::string>(json, "model_ResNext_int8_file", ""),
+		// .use_int8_models
+		optional_value_or<bool>(json, "use_int8_models", false),
+		// .canvas_features_cache_size
+		optional_value_or<std::size_t>(json, "canvas_features_cache_size", 256),
+		// .torch_threads
+		optional_value_or<std::size_t>(json, "torch_threads", 0),
+		// .torch_interop_threads
+		optional_value_or<std::size_t>(json, "torch_interop_threads", 0),
+		// .warmup_passes
+		optional_value_or<std::size_t>(json, "warmup_passes", 2),
 	};
 }
 
@@ -285,6 +364,10 @@ Settings Settings::parse_JSON_config_string(const std::string& cfg_file_contents
 		parse_tests_settings(json["tests"]),
 		// .presentation_views
 		parse_presentation_views_settings(json["presentation_views"]),
+		// .soms
+		parse_soms_settings(json["soms"]),
+		// .score_cache
+		parse_score_cache_settings(json["score_cache"]),
 		// .logger
 		parse_logger_settings(json["logger"]),
 		// .API
@@ -45,6 +45,53 @@ struct PresentationViewsSettings {
 	size_t topn_frames_per_shot;
 };
 
+struct SomsSettings {
+	/** Number of threads in the SOM worker pool shared by all the users (0 means the default). */
+	size_t num_workers;
+	/** Maximal number of iterations of the SOM fitting. */
+	size_t num_iterations;
+	/**
+	 * If non-zero, the SOMs are fitted in the "anytime" mode and the map is
+	 * published at the latest after this many milliseconds.
+	 */
+	size_t time_budget_ms;
+	/** Training algorithm of the SOMs: "online" (sequential updates) or "batch" (parallel mini-batches). */
+	std::string training_mode;
+	/** Number of weighted samples drawn for each epoch of the batch training. */
+	size_t batch_size;
+	/** Number of epochs of the batch training. */
+	size_t num_epochs;
+	/** Number of samples the quantization error is estimated from after publishing the map (0 disables it). */
+	size_t quant_error_sample_size;
+	/** If true, each SOM starts from its last codebook instead of from scratch. */
+	bool warm_start;
+	/** Number of the top scored frames on which the change of the score distribution is measured. */
+	size_t warm_start_top_k;
+	/** KL divergence of the top-K distributions at which the SOM is fitted from scratch again. */
+	float warm_start_max_divergence;
+	/** The smallest fraction of the iterations (epochs) a warm-started SOM runs. */
+	float warm_start_min_fraction;
+	/** If true, the main SOM gets a child map for each node to zoom into. */
+	bool zoom_levels;
+	/** Number of iterations of fitting one child map. */
+	size_t zoom_num_iterations;
+	/** Time the SOM job spends fitting the child maps in advance (the rest is fitted on demand). */
+	size_t zoom_time_budget_ms;
+	/** Memory budget of the SOM maps kept for the history contexts (0 disables it). */
+	size_t history_max_mb;
+};
+
+struct ScoreCacheSettings {
+	/** Memory budget of the cached inverse score vectors (0 disables the cache). */
+	size_t max_mb;
+	/** If true, the vectors are stored as half floats. */
+	bool fp16;
+	/** If true, the text being typed is scored in advance (into the cache). */
+	bool speculative;
+	/** Time the text must stay unchanged before it is scored speculatively (or its CLIP embedding prefetched). */
+	size_t speculative_debounce_ms;
+};
+
 struct LoggerSettings {
 	// ...
 };
@@ -117,6 +164,18 @@ struct EvalServerSettings {
 struct RemoteServicesSettings {
 	struct ClipQueryToVec {
 		std::string address;
+		/**
+		 * Protocol of the service:
+		 *   "distances" - returns the frame IDs and similarities of the whole dataset,
+		 *   "embedding" - returns only the text embedding (floats), the frames are scored locally.
+		 */
+		std::string mode;
+		/** Number of the text embeddings kept in memory ("embedding" mode). */
+		size_t cache_size;
+		/** If not empty, the embedding cache is persisted to this file. */
+		std::string cache_file;
+		/** If true, the embedding of the text being typed is requested in advance. */
+		bool prefetch;
 	};
 
 	struct MediaServer {
@@ -135,6 +194,19 @@ struct ModelsSettings {
 	std::string model_ResNet_SHA256;
 	std::string model_ResNext_file;
 	std::string model_ResNext_SHA256;
+	/** The int8 quantized versions of the models (see `scripts/quantize-canvas-models.py`). */
+	std::string model_ResNet_int8_file;
+	std::string model_ResNext_int8_file;
+	/** If true, the int8 models are loaded instead of the FP32 ones. */
+	bool use_int8_models;
+	/** Max number of the canvas bitmap features kept so the unchanged bitmaps skip the CNN inference. */
+	size_t canvas_features_cache_size;
+	/** Number of the torch intra-op threads (0 for the torch default). */
+	size_t torch_threads;
+	/** Number of the torch inter-op threads (0 for the torch default). */
+	size_t torch_interop_threads;
+	/** Number of the inference passes on a blank batch at the startup (0 disables the warm-up). */
+	size_t warmup_passes;
 };
 
 struct DatasetsSettings {
@@ -195,6 +267,8 @@ struct Settings {
 
 	TestsSettings tests;
 	PresentationViewsSettings presentation_views;
+	SomsSettings soms;
+	ScoreCacheSettings score_cache;
 	LoggerSettings logger;
 	ApiConfig API;
 	EvalServerSettings eval_server;
@@ -20,6 +20,8 @@
  */
 
 #include <chrono>
+#include <optional>
+#include <sstream>
 #include <stdexcept>
 #include <tuple>
 
@@ -36,21 +38,67 @@ Somhunter::Somhunter(const std::string& config_filepath)
       _dataset_frames(_settings),
       _dataset_features(_dataset_frames, _settings),
 
-      _user_context(_settings, /* \todo */ "admin", &_dataset_frames, &(_dataset_features.primary)),
+      _som_scheduler(_settings.soms.num_workers),
+
+      _user_context(_settings, /* \todo */ "admin", &_dataset_frames, &(_dataset_features.primary),
+                    &_som_scheduler),
 
       _core_settings_filepath{ config_filepath },
       _API_settings_filepath{ _settings.API.config_filepath },
       _keyword_ranker(_settings, _dataset_frames),
       _secondary_keyword_ranker{ _settings },
       _collage_ranker(_settings, &_keyword_ranker),
-      _relocation_ranker{}
+      _relocation_ranker{},
+      _score_cache{ _settings.score_cache.max_mb * 1024 * 1024, _settings.score_cache.fp16 }
 
 {
+	const bool speculate{ _settings.score_cache.speculative };
+	const bool prefetch_CLIP{ _settings.remote_services.CLIP_query_to_vec.prefetch };
+	if (speculate && _settings.score_cache.max_mb == 0) {
+		SHLOG_W("The speculative scoring is enabled but the score cache is disabled, nothing will be reused.");
+	}
+
+	if (speculate || prefetch_CLIP) {
+		_query_speculator = std::make_unique<QuerySpeculator>(
+		    std::chrono::milliseconds{ _settings.score_cache.speculative_debounce_ms },
+		    [this, speculate, prefetch_CLIP](const std::string& text_query) {
+			    // The request only starts here, it runs in the background
+			    if (prefetch_CLIP) _secondary_keyword_ranker.prefetch(text_query);
+			    if (speculate) speculate_text_query(text_query);
+		    });
+	}
+
 	generate_new_targets();
 
 	reset_search_session();
 }
 
+/**
+ * Returns the key of the moment's inverse scores in the `ScoreCache` (none for the canvas queries).
+ *
+ * The key consists of the ranker, the feature set and the whitespace-normalized query.
+ */
+static std::optional<std::string> score_cache_key(const TemporalQuery& moment_query, bool secondary) {
+	if (moment_query.is_relocation()) {
+		return "relocation/primary/" + std::to_string(moment_query.relocation);
+	}
+
+	// The canvas takes precedence over the text in the same moment
+	if (moment_query.is_text() && !moment_query.is_canvas()) {
+		std::string key{ secondary ? "clip/secondary/" : "w2vv/primary/" };
+
+		std::stringstream query_ss{ moment_query.textual };
+		bool first{ true };
+		for (std::string token; query_ss >> token; first = false) {
+			if (!first) key += ' ';
+			key += token;
+		}
+		return key;
+	}
+
+	return std::nullopt;
+}
+
 GetDisplayResult Somhunter::get_display(DisplayType d_type, FrameId selected_image, PageId page, bool log_it) {
 	_user_context._logger.poll();
 
@@ -79,6 +127,10 @@ GetDisplayResult Somhunter::get_display(DisplayType d_type, FrameId selected_ima
 			frs = get_som_relocation_display(page);
 			break;
 
+		case DisplayType::DSomZoom:
+			frs = get_som_zoom_display(selected_image);
+			break;
+
 		case DisplayType::DVideoDetail:
 			frs = get_video_detail_display(selected_image, log_it);
 			break;
@@ -459,6 +511,18 @@ RescoreResult Somhunter::rescore(Query& query, bool benchmark_run) {
 			}
 		}
 
+		// The text & relocation moments are scored in one pass over the primary features
+		const auto fused{ score_primary_moments(temporal_query, query.score_secondary()) };
+
+		// All the canvas bitmaps of all the moments go through the CNNs in one batch
+		{
+			std::vector<const CanvasQuery*> canvases;
+			for (auto&& moment_query : temporal_query) {
+				if (!moment_query.empty() && moment_query.is_canvas()) canvases.emplace_back(&moment_query.canvas);
+			}
+			if (!canvases.empty()) _collage_ranker.prepare_bitmaps(canvases);
+		}
+
 		for (size_t mi = 0; mi < temporal_query.size(); ++mi) {
 			auto&& moment_query = temporal_query[mi];
 
@@ -471,36 +535,76 @@ RescoreResult Somhunter::rescore(Query& query, bool benchmark_run) {
 				}
 			}
 
-			// ***
-			// Relocation
-			if (moment_query.is_relocation()) {
-				SHLOG_D("Running the relocation query model...");
+			// Runs the ranker of this moment, returns false if the moment was left untouched
+			auto run_ranker = [&]() -> bool {
+				// Already scored by the fused pass
+				if (fused[moment]) {
+					if (moment_query.is_relocation()) {
+						_user_context.ctx.used_tools.relocation_used = true;
+					} else {
+						_user_context.ctx.used_tools.text_search_used = true;
+					}
+					return true;
+				}
 
-				// Set used tool
-				_user_context.ctx.used_tools.relocation_used = true;
+				// ***
+				// Relocation
+				if (moment_query.is_relocation()) {
+					SHLOG_D("Running the relocation query model...");
 
-				_relocation_ranker.score(moment_query.relocation, _user_context.ctx.scores, moment, features);
-			}
-			// ***
-			// Canvas
-			else if (moment_query.is_canvas()) {
-				SHLOG_D("Running the canvas query model...");
+					// Set used tool
+					_user_context.ctx.used_tools.relocation_used = true;
 
-				_collage_ranker.score(moment_query.canvas, _user_context.ctx.scores, moment,
-				                      _user_context.ctx.used_tools, features, _dataset_frames);
+					_relocation_ranker.score(moment_query.relocation, _user_context.ctx.scores, moment, features);
+					return true;
+				}
+				// ***
+				// Canvas
+				else if (moment_query.is_canvas()) {
+					SHLOG_D("Running the canvas query model...");
+
+					_collage_ranker.score(moment_query.canvas, _user_context.ctx.scores, moment,
+					                      _user_context.ctx.used_tools, features, _dataset_frames);
+					return true;
+				}
+				// ***
+				// Plain text
+				else if (moment_query.is_text()) {
+					// If secondary features should be used
+					if (query.score_secondary()) {
+						SHLOG_D("Running plain texual model << SECONDARY SCORING >>...");
+						return rescore_keywords(_secondary_keyword_ranker, moment_query.textual, moment,
+						                        _dataset_features.secondary);
+					} else {
+						SHLOG_D("Running plain texual model << PRIMARY SCORING >>...");
+						return rescore_keywords(_keyword_ranker, moment_query.textual, moment, features);
+					}
+				}
+				return false;
+			};
 
-			}
-			// ***
-			// Plain text
-			else if (moment_query.is_text()) {
-				// If secondary features should be used
-				if (query.score_secondary()) {
-					SHLOG_D("Running plain texual model << SECONDARY SCORING >>...");
-					rescore_keywords(_secondary_keyword_ranker, moment_query.textual, moment,
-					                 _dataset_features.secondary);
-				} else {
-					SHLOG_D("Running plain texual model << PRIMARY SCORING >>...");
-					rescore_keywords(_keyword_ranker, moment_query.textual, moment, features);
+			// The inverse scores of the same moment are shared if cached or being computed by another session
+			const auto cache_key{ score_cache_key(moment_query, query.score_secondary()) };
+			if (!cache_key.has_value()) {
+				run_ranker();
+			} else {
+				std::vector<float> inv_scores(_user_context.ctx.scores.size());
+				// The slot was reset to 1.0, so it holds exactly the inverse scores of this moment
+				auto compute = [&]() { return run_ranker() ? _user_context.ctx.scores.temp(moment) : nullptr; };
+				auto lookup{ _score_cache.find_or_compute(*cache_key, inv_scores.data(), inv_scores.size(), compute) };
+
+				if (lookup == ScoreCache::Lookup::Shared) {
+					SHLOG_D("Reusing the shared inverse scores of '" << *cache_key << "'...");
+
+					// The fused pass has written the same scores already
+					if (!fused[moment]) _user_context.ctx.scores.multiply(moment, inv_scores.data());
+
+					// Set used tool (as the ranker would)
+					if (moment_query.is_relocation()) {
+						_user_context.ctx.used_tools.relocation_used = true;
+					} else {
+						_user_context.ctx.used_tools.text_search_used = true;
+					}
 				}
 			}
 			++moment;
@@ -529,10 +633,11 @@ RescoreResult Somhunter::rescore(Query& query, bool benchmark_run) {
 	rescore_feedback();
 
 	// If SOM required
-	std::thread som_t;
 	if (!benchmark_run) {
-		// Notify the SOM worker thread
-		som_t = std::thread{ [this]() { som_start(_user_context.ctx.temporal_size); } };
+		// Hand the new scores to the SOM workers (only the scores are copied, the maps are fitted in the pool)
+		// The context is pushed with this ID below
+		const size_t new_ctx_ID{ _user_context._history.size() };
+		som_start(_user_context.ctx.temporal_size, new_ctx_ID);
 	}
 
 	// Reset the "seen frames" constext for the Bayes
@@ -571,10 +676,11 @@ RescoreResult Somhunter::rescore(Query& query, bool benchmark_run) {
 
 		const auto& ss{ _settings.presentation_views };
 
+		// The (cached) top N is the first display page as well
 		const auto& top_n = _user_context.ctx.scores.top_n(_dataset_frames, TOPN_LIMIT, ss.topn_frames_per_video,
 		                                                   ss.topn_frames_per_shot);
 
-		// Log this rescore result
+		// Log this rescore result (the result list is built and sent in the background)
 		_user_context._logger.log_results(_dataset_frames, _user_context.ctx.scores, old_likes,
 		                                  _user_context.ctx.used_tools, _user_context.ctx.curr_disp_type, top_n,
 		                                  query.get_plain_text_query(), ss.topn_frames_per_video,
@@ -586,20 +692,12 @@ RescoreResult Somhunter::rescore(Query& query, bool benchmark_run) {
 	// Store this query
 	_user_context.ctx._prev_query = query;
 
-	auto res{ RescoreResult{ _user_context.ctx.ID, _user_context._history, _user_context.ctx.curr_targets, tar_pos } };
-
-	// auto ts2{ std::chrono::high_resolution_clock::now() };
-	if (!benchmark_run) {
-		som_t.join();
-	}
-	// auto ts_end{ std::chrono::high_resolution_clock::now() };
-
-	// auto d1{ std::chrono::duration_cast<std::chrono::milliseconds>(ts_end - ts2).count() };
-	// auto d2{ std::chrono::duration_cast<std::chrono::milliseconds>(ts_end - ts_start).count() };
+	// The SOMs and the result logs are still being computed at this point
+	auto ts_end{ std::chrono::high_resolution_clock::now() };
+	SHLOG_D("Rescore took " << std::chrono::duration_cast<std::chrono::milliseconds>(ts_end - ts_start).count()
+	                        << " [ms]");
 
-	// std::cout << "Blocked by `som_t` thread: " << d1 << std::endl;
-	// std::cout << "`rescore()` took: " << d2 << std::endl;
-	return res;
+	return RescoreResult{ _user_context.ctx.ID, _user_context._history, _user_context.ctx.curr_targets, tar_pos };
 }
 
 bool Somhunter::som_ready() const { return _user_context._async_SOM.map_ready(); }
@@ -654,6 +752,75 @@ void Somhunter::log_scroll(DisplayType t, float dir_Y) { _user_context._logger.l
 
 void Somhunter::log_text_query_change(const std::string& text_query) {
 	_user_context._logger.log_text_query_change(text_query);
+
+	if (_query_speculator) _query_speculator->submit(text_query);
+}
+
+std::vector<bool> Somhunter::score_primary_moments(const std::vector<TemporalQuery>& temporal_query,
+                                                  bool score_secondary) {
+	const auto& features{ _dataset_features.primary };
+
+	std::vector<bool> fused(temporal_query.size(), false);
+
+	std::vector<std::vector<float>> text_embeddings;
+	text_embeddings.reserve(temporal_query.size());
+	std::vector<const float*> queries;
+	std::vector<float*> slots;
+
+	size_t moment{ 0 };
+	for (auto&& moment_query : temporal_query) {
+		if (moment_query.empty()) continue;
+		const size_t m{ moment++ };
+
+		// The cached moments are not computed at all
+		const auto cache_key{ score_cache_key(moment_query, score_secondary) };
+		if (cache_key.has_value() && _score_cache.contains(*cache_key)) continue;
+
+		// The same precedence as in `rescore`
+		if (moment_query.is_relocation()) {
+			queries.emplace_back(features.fv(moment_query.relocation));
+		} else if (moment_query.is_canvas() || !moment_query.is_text() || score_secondary) {
+			continue;
+		} else {
+			auto embedding{ _keyword_ranker.embedding(moment_query.textual) };
+			if (embedding.empty()) continue;
+
+			text_embeddings.emplace_back(std::move(embedding));
+			queries.emplace_back(text_embeddings.back().data());
+		}
+		slots.emplace_back(_user_context.ctx.scores.temp_data(m));
+		fused[m] = true;
+	}
+
+	if (!queries.empty()) {
+		SHLOG_D("Scoring " << queries.size() << " moments in one pass over the primary features...");
+		multiply_inverse_scores(queries, features.fv(0), features.size(), features.dim(), slots);
+	}
+	return fused;
+}
+
+void Somhunter::speculate_text_query(const std::string& text_query) {
+	// Only the primary textual model is speculated (the secondary one is a remote service)
+	const auto cache_key{ score_cache_key(TemporalQuery{ text_query }, false) };
+	if (!cache_key.has_value() || _score_cache.contains(*cache_key)) return;
+
+	SHLOG_D("Speculatively scoring '" << *cache_key << "'...");
+
+	auto embedded{ _keyword_ranker.embedding(text_query) };
+	if (embedded.empty()) return;
+
+	// Scanned only by the (low priority) speculator thread, not by the pool shared with the rescores,
+	// and abandoned as soon as the text changes
+	const auto& features{ _dataset_features.primary };
+	std::vector<float> scores(features.size());
+	if (!inverse_score_rows_serial(embedded.data(), features.fv(0), features.size(), features.dim(), scores.data(),
+	                               [this]() { return _query_speculator->superseded(); })) {
+		SHLOG_D("Speculative scoring of '" << *cache_key << "' superseded.");
+		return;
+	}
+
+	// Not computed through `find_or_compute`, a rescore of the same text must not wait for this slow scan
+	_score_cache.store(*cache_key, scores.data(), scores.size());
 }
 
 void Somhunter::log_canvas_query_change() { _user_context._logger.log_canvas_query_change(); }
@@ -1365,13 +1532,34 @@ void Somhunter::rescore_feedback() {
 	_user_context.ctx.used_tools.bayes_used = true;
 }
 
-void Somhunter::som_start(size_t temporal) {
-	_user_context._async_SOM.start_work(_dataset_features.primary, _user_context.ctx.scores,
-	                                    _user_context.ctx.scores.v());
-	for (size_t i = 0; i < temporal; ++i) {
-		_user_context._temp_async_SOM[i]->start_work(_dataset_features.primary, _user_context.ctx.scores,
-		                                             _user_context.ctx.scores.temp(i));
+void Somhunter::som_start(size_t temporal, size_t ctx_ID) {
+	auto& main_SOM{ _user_context._async_SOM };
+	auto& temp_SOMs{ _user_context._temp_async_SOM };
+	auto& som_history{ _user_context._som_history };
+
+	// Keep the finished maps of the context being left
+	const size_t prev_ctx_ID{ main_SOM.result_ctx_ID() };
+	if (prev_ctx_ID != SIZE_T_ERR_VAL && !som_history.contains(prev_ctx_ID)) {
+		SomHistory::Entry entry;
+		entry.emplace_back(main_SOM.snapshot(prev_ctx_ID));
+		for (auto&& p_SOM : temp_SOMs) entry.emplace_back(p_SOM->snapshot(prev_ctx_ID));
+
+		if (entry.front().has_value()) som_history.store(prev_ctx_ID, std::move(entry));
 	}
+
+	std::optional<SomHistory::Entry> stored;
+	if (ctx_ID != SIZE_T_ERR_VAL) stored = som_history.find(ctx_ID);
+
+	auto start_or_restore = [&](AsyncSom& som, size_t i, const float* scores) {
+		if (stored.has_value() && (*stored)[i].has_value()) {
+			som.restore(*(*stored)[i], ctx_ID, scores);
+		} else {
+			som.start_work(_user_context.ctx.scores, scores, ctx_ID);
+		}
+	};
+
+	start_or_restore(main_SOM, 0, _user_context.ctx.scores.v());
+	for (size_t i = 0; i < temporal; ++i) start_or_restore(*temp_SOMs[i], i + 1, _user_context.ctx.scores.temp(i));
 }
 
 FramePointerRange Somhunter::get_random_display() {
@@ -1478,6 +1666,33 @@ FramePointerRange Somhunter::get_som_relocation_display(size_t temp_id) {
 	return FramePointerRange(_user_context.ctx.current_display);
 }
 
+FramePointerRange Somhunter::get_som_zoom_display(FrameId selected_image) {
+	auto& som{ _user_context._async_SOM };
+
+	if (!som.map_ready()) {
+		return FramePointerRange();
+	}
+
+	auto ids{ som.get_zoom_display(selected_image, _user_context.ctx.scores) };
+	if (ids.empty()) {
+		return FramePointerRange();
+	}
+
+	// Log
+	_user_context._logger.log_show_som_zoom_display(_dataset_frames, ids);
+
+	// Update context
+	for (auto id : ids) {
+		if (id == IMAGE_ID_ERR_VAL) continue;
+
+		_user_context.ctx.shown_images.insert(id);
+	}
+	_user_context.ctx.current_display = _dataset_frames.ids_to_video_frame(ids);
+	_user_context.ctx.curr_disp_type = DisplayType::DSomZoom;
+
+	return FramePointerRange(_user_context.ctx.current_display);
+}
+
 FramePointerRange Somhunter::get_video_detail_display(FrameId selected_image, bool log_it) {
 	VideoId v_id = _dataset_frames.get_video_id(selected_image);
 
@@ -1578,19 +1793,14 @@ const UserContext& Somhunter::switch_search_context(size_t index, size_t src_sea
 	SHLOG_I("Switching to context '" << index << "'...");
 	_user_context._logger.log_search_context_switch(index, src_search_ctx_ID);
 
-	// SOM must stop first
-	while (!_user_context._async_SOM.map_ready()) {
-		std::this_thread::sleep_for(10ms);
-	}
-
 	// Get the desired state
 	const auto& destContext{ _user_context._history[index] };
 
 	// Copy the history state into the current one
 	_user_context.ctx = SearchContext{ destContext };
 
-	// Kick-off the SOM for the old-new state
-	som_start(_user_context.ctx.temporal_size);
+	// Restore (or kick-off) the SOM for the old-new state (the running computation is abandoned, nothing to wait for)
+	som_start(_user_context.ctx.temporal_size, index);
 
 	// This action forces the result log to be send again
 	_user_context._force_result_log = true;
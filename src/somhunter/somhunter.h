@@ -34,10 +34,13 @@
 #include "keyword-clip-ranker.h"
 #include "keyword-ranker.h"
 #include "logger.h"
+#include "query-speculator.h"
 #include "query-types.h"
 #include "relocation-ranker.h"
 #include "scores.h"
+#include "score-cache.h"
 #include "search-context.h"
+#include "som-scheduler.h"
 #include "task-target-helper.h"
 #include "user-context.h"
 #include "utils.hpp"
@@ -109,6 +112,9 @@ public:
 
 	bool som_ready(size_t temp_id) const;
 
+	/** Returns the metrics of the SOM worker pool (queue depth, wait times...). */
+	SomScheduler::Stats som_scheduler_stats() const { return _som_scheduler.stats(); }
+
 	/** Resets current search context and starts new search */
 	void reset_search_session();
 
@@ -193,11 +199,29 @@ private:
 
 	/**
 	 *	Applies text query from the user.
+	 *
+	 *	Returns false if the moment was left untouched.
 	 */
 	template <typename SpecificKWRanker, typename SpecificFrameFeatures>
-	void rescore_keywords(SpecificKWRanker& kw_ranker, const TextualQuery& query, size_t temporal,
+	bool rescore_keywords(SpecificKWRanker& kw_ranker, const TextualQuery& query, size_t temporal,
 	                      const SpecificFrameFeatures& features);
 
+	/**
+	 * Scores all the moments embedded into the primary features (text and relocation, unless cached) in one pass
+	 * over the features, straight into their temporal slots.
+	 *
+	 * Returns the flags of the scored moments (indexed by the non-empty moments).
+	 */
+	std::vector<bool> score_primary_moments(const std::vector<TemporalQuery>& temporal_query, bool score_secondary);
+
+	/**
+	 * Computes the inverse scores of the text query into the score cache
+	 * (for the upcoming rescore).
+	 *
+	 * Runs serially on the speculator thread and gives up once a newer text is submitted.
+	 */
+	void speculate_text_query(const std::string& text_query);
+
 	/**
 	 * Applies the relevance feedback from the user based on images
 	 * the user already saw (as implicit negative examples).
@@ -206,8 +230,10 @@ private:
 
 	/**
 	 *	Gives the SOM worker the new work.
+	 *
+	 *	The finished maps are kept for their context first, the maps of the `ctx_ID` context are restored if stored.
 	 */
-	void som_start(size_t temporal);
+	void som_start(size_t temporal, size_t ctx_ID = SIZE_T_ERR_VAL);
 
 	FramePointerRange get_random_display();
 
@@ -219,6 +245,9 @@ private:
 
 	FramePointerRange get_som_relocation_display(size_t temp_id);
 
+	/** Display of the child map of the main SOM node the `selected_image` belongs to. */
+	FramePointerRange get_som_zoom_display(FrameId selected_image);
+
 	FramePointerRange get_video_detail_display(FrameId selected_image, bool log_it = true);
 
 	FramePointerRange get_topKNN_display(FrameId selected_image, PageId page);
@@ -253,6 +282,12 @@ private:
 	const DatasetFrames _dataset_frames;
 	const DatasetFeatures _dataset_features;
 
+	// ********************************
+	// SOM worker pool
+	//		(shared for all the users, must outlive their SOMs)
+	// ********************************
+	SomScheduler _som_scheduler;
+
 	// ********************************
 	// User contexts
 	//		(private for each unique user session)
@@ -270,16 +305,22 @@ private:
 	KeywordClipRanker _secondary_keyword_ranker;
 	CanvasQueryRanker _collage_ranker;
 	const RelocationRanker _relocation_ranker;
+
+	/** Inverse score vectors of the recent query moments (shared for all the users). */
+	ScoreCache _score_cache;
+	/** Scores the text being typed (or prefetches its CLIP embedding) in advance if enabled. */
+	std::unique_ptr<QuerySpeculator> _query_speculator;
 };
 
 // ---
 
 template <typename SpecificKWRanker, typename SpecificFrameFeatures>
-void Somhunter::rescore_keywords(SpecificKWRanker& kw_ranker, const TextualQuery& query, size_t temporal,
+bool Somhunter::rescore_keywords(SpecificKWRanker& kw_ranker, const TextualQuery& query, size_t temporal,
                                  const SpecificFrameFeatures& features) {
-	kw_ranker.rank_sentence_query(query, _user_context.ctx.scores, features, temporal);
+	bool scored{ kw_ranker.rank_sentence_query(query, _user_context.ctx.scores, features, temporal) };
 
 	_user_context.ctx.used_tools.text_search_used = true;
+	return scored;
 }
 
 };      // namespace sh
@@ -20,9 +20,11 @@
 
 #include "async-som.h"
 
+#include <algorithm>
 #include <chrono>
+#include <execution>
+#include <numeric>
 #include <random>
-#include <thread>
 
 #include "common.h"
 #include "som.h"
@@ -36,141 +38,322 @@ using namespace sh;
 #	define SHLOG_D(x) _dont_write_log_err
 #endif
 
-void AsyncSom::async_som_worker(AsyncSom* parent, const Settings& _logger_settings) {
-	std::random_device rd;
-	std::mt19937 rng(rd());
-	const size_t width = parent->width;
-	const size_t height = parent->height;
+/** Manhattan distances between all the pairs of nodes of the grid. */
+static std::vector<float> grid_distances(size_t width, size_t height) {
+	std::vector<float> nhbrdist(width * width * height * height);
+	for (size_t x1 = 0; x1 < width; ++x1)
+		for (size_t y1 = 0; y1 < height; ++y1)
+			for (size_t x2 = 0; x2 < width; ++x2)
+				for (size_t y2 = 0; y2 < height; ++y2)
+					nhbrdist[x1 + width * (y1 + height * (x2 + width * y2))] =
+					    abs(float(x1) - float(x2)) + abs(float(y1) - float(y2));
+	return nhbrdist;
+}
 
-	SHLOG_D("SOM worker is starting...");
+static size_t nearest_cluster_with_atleast(const ClusterMapping& mapping, const std::vector<float>& koho, size_t dim,
+                                           const float* vec, const std::vector<size_t>& stolen_count) {
+	float min = std::numeric_limits<float>::max();
+	size_t res = 0;
+	for (size_t i = 0; i < mapping.num_clusters(); ++i) {
+		if (mapping.size(i) > stolen_count[i]) {
+			float tmp = d_sqeucl(koho.data() + dim * i, vec, dim);
+			if (min > tmp) {
+				min = tmp;
+				res = i;
+			}
+		}
+	}
 
-	while (!parent->terminate) {
-		std::vector<float> points(parent->_features_data_len);
-		std::vector<float> scores(parent->_scores_data_len);
-		std::vector<bool> present_mask(parent->_scores_data_len);
-		size_t _size;
+	return res;
+}
 
-		{
-			// get new data, or wait for them.
+/**
+ * Draws one of the frames `[first, last)` w.r.t. their scores by the prefix-sum sampling;
+ * the frames in the (sorted) `excluded` list have zero weight.
+ *
+ * Returns `ERR_VAL<FrameId>()` if there is nothing to draw from.
+ */
+static FrameId weighted_pick(const FrameId* first, const FrameId* last, const ScoreModel& model_scores,
+                             const std::vector<FrameId>& excluded, std::vector<float>& prefix, std::mt19937& rng) {
+	const size_t n = size_t(last - first);
+	prefix.resize(n);
+
+	float sum = 0.0F;
+	for (size_t i = 0; i < n; ++i) {
+		if (excluded.empty() || !std::binary_search(excluded.begin(), excluded.end(), first[i]))
+			sum += model_scores[first[i]];
+		prefix[i] = sum;
+	}
+	if (n == 0 || !(sum > 0.0F)) return ERR_VAL<FrameId>();
 
-			std::unique_lock lck(parent->worker_lock);
-			if (parent->terminate) continue;
-			if (!parent->new_data) {
-				parent->new_data_wakeup.wait(lck);
-				continue;
-			}
+	float x = std::uniform_real_distribution<float>(0.0F, sum)(rng);
+	size_t i = size_t(std::upper_bound(prefix.begin(), prefix.end(), x) - prefix.begin());
+	return first[std::min(i, n - 1)];
+}
 
-			points.swap(parent->points);
-			scores.swap(parent->scores);
-			present_mask.swap(parent->present_mask);
-			_size = scores.size();
-			parent->new_data = false;
-			parent->m_ready = false;
-			SHLOG_D("SOM worker just got new work...");
+/** Picks one frame per node of the map (w.r.t. the scores), empty nodes borrow from their nearest nodes. */
+static std::vector<FrameId> compose_display(size_t width, size_t height, size_t dim, const ClusterMapping& mapping,
+                                            const std::vector<float>& koho, const ScoreModel& model_scores) {
+	std::mt19937 rng{ std::random_device{}() };
+	std::vector<float> prefix;
+	const std::vector<FrameId> no_exclusions;
+
+	std::vector<FrameId> ids;
+	ids.resize(width * height);
+
+	// Select weighted example from cluster
+	for (size_t i = 0; i < width * height; ++i) {
+		if (!mapping.empty(i)) {
+			ids[i] = weighted_pick(mapping.begin(i), mapping.end(i), model_scores, no_exclusions, prefix, rng);
 		}
+	}
 
-		if (parent->new_data || parent->terminate) continue;
+	[[maybe_unused]] auto begin = std::chrono::steady_clock::now();
 
-		// at this point: restart is off, input is ready.
+	// Frames already on the display, the empty clusters must not repeat them
+	std::vector<FrameId> chosen;
+	for (size_t i = 0; i < width * height; ++i)
+		if (!mapping.empty(i)) chosen.push_back(ids[i]);
+	std::sort(chosen.begin(), chosen.end());
 
-		std::vector<float> nhbrdist(width * width * height * height);
-		for (size_t x1 = 0; x1 < width; ++x1)
-			for (size_t y1 = 0; y1 < height; ++y1)
-				for (size_t x2 = 0; x2 < width; ++x2)
-					for (size_t y2 = 0; y2 < height; ++y2)
-						nhbrdist[x1 + width * (y1 + height * (x2 + width * y2))] =
-						    abs(float(x1) - float(x2)) + abs(float(y1) - float(y2));
+	// Fix empty cluster
+	std::vector<size_t> stolen_count(width * height, 1);
+	for (size_t i = 0; i < width * height; ++i) {
+		if (mapping.empty(i)) {
+			SHLOG_D("Fixing cluster " << i);
 
-		if (parent->new_data || parent->terminate) continue;
+			// Get nearest cluster with enough elements
+			size_t clust = nearest_cluster_with_atleast(mapping, koho, dim, koho.data() + i * dim, stolen_count);
+			stolen_count[clust]++;
 
-		const auto& pfs{ _logger_settings.datasets.primary_features };
+			// Subsitute with "empty" frame if no candidates left
+			ids[i] = weighted_pick(mapping.begin(clust), mapping.end(clust), model_scores, chosen, prefix, rng);
 
-		std::vector<float> koho(width * height * pfs._dim, 0);
-		float negAlpha = -0.01f;
-		float negRadius = 1.1f;
-		float alphasA[2] = { 0.3f, 0.1f };
-		float alphasB[2] = { negAlpha * alphasA[0], negAlpha * alphasA[1] };
-		float radiiA[2] = { float(width + height) / 3, 0.1f };
-		float radiiB[2] = { negRadius * radiiA[0], negRadius * radiiA[1] };
+			if (ids[i] != ERR_VAL<FrameId>())
+				chosen.insert(std::upper_bound(chosen.begin(), chosen.end(), ids[i]), ids[i]);
+		}
+	}
 
-		std::chrono::high_resolution_clock::time_point begin = std::chrono::high_resolution_clock::now();
-		fit_SOM(_size, width * height, pfs._dim, SOM_ITERS, points, koho, nhbrdist, alphasA, radiiA, alphasB, radiiB,
-		        scores, present_mask, rng);
-		std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
-		SHLOG_D("SOM took " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() << " [ms]");
+	[[maybe_unused]] auto end = std::chrono::steady_clock::now();
+	SHLOG_D("Fixing clusters took " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count()
+	                                << " [ms]");
+	return ids;
+}
+
+void AsyncSom::async_som_job(AsyncSom* parent) {
+	auto& rng{ parent->_rng };
+	const size_t width = parent->width;
+	const size_t height = parent->height;
+	const auto& soms_settings{ parent->_settings.soms };
+
+	// Any new data (or a restored result) make the current computation obsolete
+	size_t generation{ 0 };
+	auto should_stop = [parent, &generation]() {
+		return parent->terminate.load() || parent->_generation.load() != generation;
+	};
+
+	// The last published codebook and the scores it was fitted to (for the warm starts)
+	auto& last_koho{ parent->_last_koho };
+	auto& last_scores{ parent->_last_scores };
+
+	SHLOG_D("SOM job is starting...");
+
+	// The features are read in place (they are immutable and outlive the SOMs)
+	const float* points{ parent->_p_features->fv(0) };
+	std::vector<float> scores(parent->_scores_data_len);
+	std::vector<bool> present_mask(parent->_scores_data_len);
+	size_t _size;
+	size_t ctx_ID;
+
+	{
+		// get the new data (a newer job may have eaten them already)
+
+		std::unique_lock lck(parent->worker_lock);
+		if (parent->terminate || !parent->new_data) return;
+
+		scores.swap(parent->scores);
+		present_mask.swap(parent->present_mask);
+		_size = scores.size();
+		generation = parent->_generation;
+		ctx_ID = parent->_ctx_ID;
+		parent->new_data = false;
+		SHLOG_D("SOM worker just got new work...");
+	}
+
+	if (should_stop()) return;
+
+	// at this point: restart is off, input is ready.
+
+	std::vector<float> nhbrdist{ grid_distances(width, height) };
 
-		if (parent->new_data || parent->terminate) continue;
+	if (should_stop()) return;
 
-		std::vector<size_t> point_to_koho(_size);
-		begin = std::chrono::high_resolution_clock::now();
-		{
-			std::size_t n_threads = std::min<std::size_t>(MAX_NUM_TEMP_WORKERS, std::thread::hardware_concurrency());
-			std::vector<std::thread> threads(n_threads);
+	const auto& pfs{ parent->_settings.datasets.primary_features };
+	const size_t parallelism{ parent->_p_scheduler->parallelism(parent->_priority) };
 
-			auto worker = [&](size_t id) {
-				size_t start = id * _size / n_threads;
-				size_t end = (id + 1) * _size / n_threads;
-				map_points_to_kohos(start, end, width * height, pfs._dim, points, koho, point_to_koho, present_mask);
-			};
+	std::vector<float> koho(width * height * pfs._dim, 0);
+	float negAlpha = -0.01f;
+	float negRadius = 1.1f;
+	float alphasA[2] = { 0.3f, 0.1f };
+	float alphasB[2] = { negAlpha * alphasA[0], negAlpha * alphasA[1] };
+	float radiiA[2] = { float(width + height) / 3, 0.1f };
+	float radiiB[2] = { negRadius * radiiA[0], negRadius * radiiA[1] };
 
-			for (size_t i = 0; i < n_threads; ++i) threads[i] = std::thread(worker, i);
+	// Small change of the scores -> continue from the last map with a shortened annealing
+	float fraction = 1.0F;
+	if (soms_settings.warm_start && last_koho.size() == koho.size()) {
+		float divergence = top_k_divergence(scores, last_scores, soms_settings.warm_start_top_k);
+		if (divergence < soms_settings.warm_start_max_divergence) {
+			fraction = std::max(soms_settings.warm_start_min_fraction,
+			                    divergence / soms_settings.warm_start_max_divergence);
+			koho = last_koho;
 
-			for (size_t i = 0; i < n_threads; ++i) threads[i].join();
+			// The map is already ordered, skip the beginning of the schedule
+			for (float* param : { alphasA, alphasB, radiiA, radiiB })
+				param[0] = param[1] + fraction * (param[0] - param[1]);
 		}
-		end = std::chrono::high_resolution_clock::now();
-		SHLOG_D("Mapping took " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count()
-		                        << " [ms]");
+		SHLOG_D("SOM score divergence " << divergence << ", running " << fraction << " of the schedule");
+	}
+	const size_t num_iterations = std::max<size_t>(1, size_t(fraction * soms_settings.num_iterations));
+	const size_t num_epochs = std::max<size_t>(1, size_t(fraction * soms_settings.num_epochs));
+
+	std::chrono::high_resolution_clock::time_point begin = std::chrono::high_resolution_clock::now();
+	bool fitted{ false };
+	if (soms_settings.training_mode == "batch") {
+		fitted = fit_SOM_batch(width * height, pfs._dim, num_epochs, soms_settings.batch_size, points, koho,
+		                       nhbrdist, radiiA, scores, rng, should_stop,
+		                       std::chrono::milliseconds{ soms_settings.time_budget_ms }, parallelism);
+	} else {
+		fitted = fit_SOM(_size, width * height, pfs._dim, num_iterations, points, koho, nhbrdist, alphasA,
+		                 radiiA, alphasB, radiiB, scores, present_mask, rng, should_stop,
+		                 std::chrono::milliseconds{ soms_settings.time_budget_ms });
+	}
+	std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+	if (!fitted) return;
+
+	auto fit_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count();
+	SHLOG_D("SOM took " << fit_ms << " [ms]");
 
-		if (parent->new_data || parent->terminate) continue;
+	if (should_stop()) return;
 
-		parent->mapping.clear();
-		parent->mapping.resize(width * height);
-		for (FrameId im = 0; im < point_to_koho.size(); ++im)
-			if (present_mask[im]) parent->mapping[point_to_koho[im]].push_back(im);
+	// The frames that are not present stay unmapped
+	std::vector<size_t> point_to_koho(_size, ERR_VAL<size_t>());
+	const auto present_ids{ present_points(present_mask) };
+	begin = std::chrono::high_resolution_clock::now();
+	{
+		// As many chunks as the scheduler grants this job (one means mapping on the job thread)
+		const size_t n_chunks{ parallelism };
+		std::for_each(std::execution::par, ioterable<size_t>(0), ioterable<size_t>(n_chunks), [&](size_t id) {
+			size_t start = id * present_ids.size() / n_chunks;
+			size_t end = (id + 1) * present_ids.size() / n_chunks;
+			map_points_to_kohos(present_ids, start, end, width * height, pfs._dim, points, koho, point_to_koho,
+			                    should_stop);
+		});
+	}
+	end = std::chrono::high_resolution_clock::now();
+	SHLOG_D("Mapping took " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count()
+	                        << " [ms]");
+
+	if (should_stop()) return;
+
+	auto result{ std::make_shared<SomResult>() };
+	result->mapping = ClusterMapping::build(
+	    width * height, present_ids.size(), [&](size_t i) { return present_ids[i]; },
+	    [&](size_t i) { return point_to_koho[present_ids[i]]; });
+	result->koho = std::move(koho);
+	result->fit_duration_ms = size_t(fit_ms);
+	result->ctx_ID = ctx_ID;
+
+	if (parent->_zoom_enabled) {
+		result->zoom_maps.resize(width * height);
+		result->scores = scores;
+		result->point_to_node = std::move(point_to_koho);
+	}
 
-		parent->koho = std::move(koho);
+	// Publish, readers of the previous result keep it until they are done
+	{
+		std::unique_lock lck(parent->worker_lock);
+		if (parent->_generation != generation) return;
 
-		std::atomic_thread_fence(std::memory_order_release);
+		std::atomic_store(&parent->_result, std::shared_ptr<const SomResult>{ result });
 		parent->m_ready = true;
+	}
+
+	// The quality estimate does not delay the display
+	if (soms_settings.quant_error_sample_size > 0) {
+		result->quant_error = sh::quantization_error(width * height, pfs._dim, soms_settings.quant_error_sample_size,
+		                                             points, result->koho, scores, rng);
+		SHLOG_D("SOM quantization error " << result->quant_error.load());
+	}
 
-		/* TODO
-		 * add the parent->restart checks to SOM functions so that they
-		 * may break in the middle
-		 */
+	if (soms_settings.warm_start) {
+		last_koho = result->koho;
+		last_scores = std::move(scores);
 	}
-	SHLOG_D("SOM worker finished.");
+
+	if (parent->_zoom_enabled) {
+		// Eagerly fit the children of the largest nodes while the budget lasts, the rest is fitted on demand
+		auto deadline =
+		    std::chrono::steady_clock::now() + std::chrono::milliseconds{ soms_settings.zoom_time_budget_ms };
+
+		std::vector<size_t> nodes(width * height);
+		std::iota(nodes.begin(), nodes.end(), 0);
+		std::sort(nodes.begin(), nodes.end(),
+		          [&result](size_t a, size_t b) { return result->mapping.size(a) > result->mapping.size(b); });
+
+		for (size_t node : nodes) {
+			if (std::chrono::steady_clock::now() >= deadline) break;
+
+			{
+				std::unique_lock lck(result->zoom_lock);
+				if (!result->zoom_maps[node].koho.empty()) continue;
+			}
+
+			// Fitted without the lock so that the zoom requests are not blocked meanwhile
+			SomZoomMap zoom_map;
+			if (!parent->fit_zoom_map(*result, node, zoom_map, rng, should_stop)) break;
+
+			// Unless fitted on demand in the meantime
+			std::unique_lock lck(result->zoom_lock);
+			if (result->zoom_maps[node].koho.empty()) result->zoom_maps[node] = std::move(zoom_map);
+		}
+	}
+	SHLOG_D("SOM job finished.");
 }
 
-AsyncSom::AsyncSom(const Settings& _logger_settings, size_t w, size_t h, const PrimaryFrameFeatures& fs,
-                   const ScoreModel& sc)
-    :
+AsyncSom::AsyncSom(const Settings& settings, SomScheduler* p_scheduler, SomScheduler::Priority priority, size_t w,
+                   size_t h, const PrimaryFrameFeatures& fs, const ScoreModel& sc)
+    : _settings{ settings },
+      _p_scheduler{ p_scheduler },
+      _priority{ priority },
+      _p_features{ &fs },
+      _dim{ fs.dim() },
 
-      _features_data_len{ fs.dim() * sc.size() },
       _scores_data_len{ sc.size() },
-      points(_features_data_len),
       scores(_scores_data_len),
+      _rng{ std::random_device{}() },
+      _zoom_enabled{ priority == SomScheduler::Priority::MainDisplay && settings.soms.zoom_levels },
 
       width(w),
       height(h) {
-	new_data = m_ready = terminate = false;
-	worker = std::thread(async_som_worker, this, _logger_settings);
+	new_data = false;
+	terminate = false;
+	m_ready = false;
+	_generation = 0;
 }
 
 AsyncSom::~AsyncSom() {
-	SHLOG_D("Requesting SOM worker termination...");
+	SHLOG_D("Cancelling SOM jobs...");
 	terminate = true;
-	new_data_wakeup.notify_all();
-	worker.join();
-	SHLOG_D("SOM worker terminated.");
+	_p_scheduler->cancel(this);
+	SHLOG_D("SOM jobs cancelled.");
 }
 
-void AsyncSom::start_work(const PrimaryFrameFeatures& fs, const ScoreModel& sc, const float* scores_orig) {
+void AsyncSom::start_work(const ScoreModel& sc, const float* scores_orig, size_t ctx_ID) {
 	{
 		std::unique_lock lck(worker_lock);
 
-		// points = std::vector<float>(fs.fv(0), fs.fv(0) + fs.dim() * sc.size());
 		// scores = std::vector<float>(scores_orig, scores_orig + sc.size());
-		std::memcpy(points.data(), fs.fv(0), _features_data_len * sizeof(float));
 		std::memcpy(scores.data(), scores_orig, _scores_data_len * sizeof(float));
 
 		// present_mask = std::vector<bool>(sc.size(), false);
@@ -180,63 +363,138 @@ void AsyncSom::start_work(const PrimaryFrameFeatures& fs, const ScoreModel& sc,
 			present_mask.emplace_back(sc.is_masked(ii));
 		}
 
+		_ctx_ID = ctx_ID;
+		++_generation;
 		new_data = true;
+		m_ready = false;
 	}
 
-	new_data_wakeup.notify_all();
+	_p_scheduler->submit(this, _priority, [this]() { async_som_job(this); });
 }
 
-std::vector<FrameId> AsyncSom::get_display(ScoreModel model_scores) const {
-	std::vector<FrameId> ids;
-	ids.resize(width * height);
+std::vector<FrameId> AsyncSom::get_display(const ScoreModel& model_scores) const {
+	auto res{ result() };
+	if (!res) return {};
 
-	// Select weighted example from cluster
-	for (size_t i = 0; i < width; ++i) {
-		for (size_t j = 0; j < height; ++j) {
-			if (!map(i + width * j).empty()) {
-				FrameId id = model_scores.weighted_example(map(i + width * j));
-				ids[i + width * j] = id;
-			}
-		}
+	return compose_display(width, height, _dim, res->mapping, res->koho, model_scores);
+}
+
+bool AsyncSom::fit_zoom_map(const SomResult& result, size_t node, SomZoomMap& zoom_map, std::mt19937& rng,
+                            const SomStopPredicate& should_stop) const {
+	const FrameId* ids{ result.mapping.begin(node) };
+	const size_t k = width * height;
+	const size_t n = result.mapping.size(node);
+
+	// Only the points of the node are touched
+	std::vector<float> points(n * _dim);
+	std::vector<float> scores(n);
+	for (size_t i = 0; i < n; ++i) {
+		std::copy_n(_p_features->fv(ids[i]), _dim, points.data() + i * _dim);
+		scores[i] = result.scores[ids[i]];
 	}
+	std::vector<float> koho(k * _dim, 0);
+	std::vector<size_t> point_to_koho(n);
+	if (n > 0) {
+		float negAlpha = -0.01f;
+		float negRadius = 1.1f;
+		float alphasA[2] = { 0.3f, 0.1f };
+		float alphasB[2] = { negAlpha * alphasA[0], negAlpha * alphasA[1] };
+		float radiiA[2] = { float(width + height) / 3, 0.1f };
+		float radiiB[2] = { negRadius * radiiA[0], negRadius * radiiA[1] };
 
-	[[maybe_unused]] auto begin = std::chrono::steady_clock::now();
-	// Fix empty cluster
-	std::vector<size_t> stolen_count(width * height, 1);
-	for (size_t i = 0; i < width; ++i) {
-		for (size_t j = 0; j < height; ++j) {
-			if (map(i + width * j).empty()) {
-				SHLOG_D("Fixing cluster " << i + width * j);
-
-				// Get SOM node of empty cluster
-				auto k = get_koho(i + width * j);
-
-				// Get nearest cluster with enough elements
-				size_t clust = nearest_cluster_with_atleast(k, stolen_count);
-
-				stolen_count[clust]++;
-				std::vector<FrameId> ci = map(clust);
-
-				for (FrameId ii : ids) {
-					auto fi = std::find(ci.begin(), ci.end(), ii);
-					if (fi != ci.end()) ci.erase(fi);
-				}
-
-				// If some frame candidates
-				if (!ci.empty()) {
-					FrameId id = model_scores.weighted_example(ci);
-					ids[i + width * j] = id;
-				}
-				// Subsitute with "empty" frame
-				else {
-					ids[i + width * j] = ERR_VAL<FrameId>();
-				}
-			}
-		}
+		if (!fit_SOM(n, k, _dim, _settings.soms.zoom_num_iterations, points.data(), koho,
+		             grid_distances(width, height), alphasA, radiiA, alphasB, radiiB, scores,
+		             std::vector<bool>(n, true), rng, should_stop))
+			return false;
+
+		std::vector<size_t> local_ids(n);
+		std::iota(local_ids.begin(), local_ids.end(), 0);
+		if (!map_points_to_kohos(local_ids, 0, n, k, _dim, points.data(), koho, point_to_koho, should_stop))
+			return false;
 	}
 
-	[[maybe_unused]] auto end = std::chrono::steady_clock::now();
-	SHLOG_D("Fixing clusters took " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count()
-	                                << " [ms]");
-	return ids;
+	zoom_map.mapping = ClusterMapping::build(
+	    k, n, [ids](size_t i) { return ids[i]; }, [&point_to_koho](size_t i) { return point_to_koho[i]; });
+	zoom_map.koho = std::move(koho);
+
+	return true;
+}
+
+std::vector<FrameId> AsyncSom::get_zoom_display(FrameId frame_ID, const ScoreModel& model_scores) const {
+	// Both the node and its child map from the same result
+	auto res{ result() };
+	if (!res || frame_ID >= res->point_to_node.size()) return {};
+
+	const size_t node{ res->point_to_node[frame_ID] };
+	if (node >= res->zoom_maps.size()) return {};
+
+	{
+		std::unique_lock lck(res->zoom_lock);
+		const auto& zoom_map{ res->zoom_maps[node] };
+		if (!zoom_map.koho.empty())
+			return compose_display(width, height, _dim, zoom_map.mapping, zoom_map.koho, model_scores);
+	}
+
+	// Fitted without the lock the same way as the eager ones, so that they are not blocked meanwhile
+	SHLOG_D("Fitting zoom map of the node " << node << " on demand...");
+	SomZoomMap fitted;
+	std::mt19937 rng{ std::random_device{}() };
+	fit_zoom_map(*res, node, fitted, rng);
+
+	// Unless fitted eagerly in the meantime
+	std::unique_lock lck(res->zoom_lock);
+	auto& zoom_map{ res->zoom_maps[node] };
+	if (zoom_map.koho.empty()) zoom_map = std::move(fitted);
+
+	return compose_display(width, height, _dim, zoom_map.mapping, zoom_map.koho, model_scores);
+}
+
+std::optional<SomSnapshot> AsyncSom::snapshot(size_t ctx_ID) const {
+	auto res{ result() };
+	if (!map_ready() || !res || res->ctx_ID != ctx_ID) return std::nullopt;
+
+	const size_t k = width * height;
+	if (k >= SomSnapshot::NOT_PRESENT) return std::nullopt;
+
+	SomSnapshot snap{ std::vector<uint8_t>(_scores_data_len, SomSnapshot::NOT_PRESENT), res->koho,
+		              res->fit_duration_ms, res->quant_error.load() };
+	for (size_t node = 0; node < k; ++node)
+		for (const FrameId* it = res->mapping.begin(node); it != res->mapping.end(node); ++it)
+			snap.nodes[*it] = uint8_t(node);
+
+	return snap;
+}
+
+void AsyncSom::restore(const SomSnapshot& snap, size_t ctx_ID, const float* scores_orig) {
+	const size_t k = width * height;
+
+	auto result{ std::make_shared<SomResult>() };
+	const auto present_ids{ present_points(snap.present_mask()) };
+	result->mapping = ClusterMapping::build(
+	    k, present_ids.size(), [&](size_t i) { return present_ids[i]; },
+	    [&](size_t i) { return size_t(snap.nodes[present_ids[i]]); });
+	result->koho = snap.koho;
+	result->fit_duration_ms = snap.fit_duration_ms;
+	result->quant_error = snap.quant_error;
+	result->ctx_ID = ctx_ID;
+
+	if (_zoom_enabled) {
+		result->zoom_maps.resize(k);
+		result->scores.assign(scores_orig, scores_orig + _scores_data_len);
+		result->point_to_node.resize(snap.nodes.size());
+		std::transform(snap.nodes.begin(), snap.nodes.end(), result->point_to_node.begin(), [](uint8_t node) {
+			return node == SomSnapshot::NOT_PRESENT ? ERR_VAL<size_t>() : size_t(node);
+		});
+	}
+
+	{
+		std::unique_lock lck(worker_lock);
+
+		// Whatever is being computed now is obsolete
+		++_generation;
+		new_data = false;
+
+		std::atomic_store(&_result, std::shared_ptr<const SomResult>{ result });
+		m_ready = true;
+	}
 }
@@ -22,57 +22,188 @@
 #define asyncsom_h
 
 #include <atomic>
-#include <condition_variable>
-#include <thread>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <random>
 #include <vector>
 
 #include "dataset-features.h"
 #include "dataset-frames.h"
 #include "scores.h"
+#include "som-scheduler.h"
+#include "som.h"
 
 namespace sh {
+
+/**
+ * Points of the SOM nodes in the CSR layout.
+ *
+ * The points of the node `i` are `ids[offsets[i], offsets[i + 1])`, in the ascending order.
+ */
+struct ClusterMapping {
+	std::vector<size_t> offsets;
+	std::vector<FrameId> ids;
+
+	size_t num_clusters() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+	size_t size(size_t i) const { return offsets[i + 1] - offsets[i]; }
+	bool empty(size_t i) const { return size(i) == 0; }
+	const FrameId* begin(size_t i) const { return ids.data() + offsets[i]; }
+	const FrameId* end(size_t i) const { return ids.data() + offsets[i + 1]; }
+
+	/** Builds the mapping of `n` points with the IDs `id_of(i)` assigned to the nodes `node_of(i)`. */
+	template <typename IdFn, typename NodeFn>
+	static ClusterMapping build(size_t k, size_t n, IdFn id_of, NodeFn node_of) {
+		ClusterMapping res;
+
+		// Counting sort by the node
+		res.offsets.assign(k + 1, 0);
+		for (size_t i = 0; i < n; ++i) ++res.offsets[node_of(i) + 1];
+		std::partial_sum(res.offsets.begin(), res.offsets.end(), res.offsets.begin());
+
+		std::vector<size_t> pos(res.offsets.begin(), res.offsets.end() - 1);
+		res.ids.resize(n);
+		for (size_t i = 0; i < n; ++i) res.ids[pos[node_of(i)]++] = FrameId(id_of(i));
+
+		return res;
+	}
+};
+
+/** Child map of one SOM node. */
+struct SomZoomMap {
+	ClusterMapping mapping;
+	/** Empty if not fitted yet. */
+	std::vector<float> koho;
+};
+
+/**
+ * Result of one SOM run.
+ *
+ * Published as an immutable snapshot; readers hold a `shared_ptr` to it,
+ * so a newer result never changes the data under their hands. The only
+ * mutable part are the lazily fitted child maps guarded by `zoom_lock`.
+ */
+struct SomResult {
+	ClusterMapping mapping;
+	std::vector<float> koho;
+	/** Fitting time of the map. */
+	size_t fit_duration_ms{};
+	/** Quantization error of the map, estimated after publishing (negative if not estimated). */
+	mutable std::atomic<float> quant_error{ -1.0F };
+	/** ID of the search context the map belongs to (`SIZE_T_ERR_VAL` if none). */
+	size_t ctx_ID{ SIZE_T_ERR_VAL };
+
+	/*
+	 * Zoom levels (main display SOM only):
+	 *
+	 * Each node of the map gets a child map of the same size fitted only
+	 * to the points of that node. The children are fitted eagerly right
+	 * after the map is published (within a time budget) and lazily on
+	 * the first zoom request for the rest.
+	 */
+	/** The scores the map was fitted to. */
+	std::vector<float> scores;
+	/** The node of each present point. */
+	std::vector<size_t> point_to_node;
+	mutable std::mutex zoom_lock;
+	mutable std::vector<SomZoomMap> zoom_maps;
+};
+
+/**
+ * Compact copy of a finished `SomResult` kept in the search history.
+ *
+ * The mapping is stored as one byte per frame (the node index or `NOT_PRESENT`)
+ * instead of the IDs and the offsets, the zoom levels are not kept.
+ */
+struct SomSnapshot {
+	static constexpr uint8_t NOT_PRESENT = 255;
+
+	std::vector<uint8_t> nodes;
+	std::vector<float> koho;
+	size_t fit_duration_ms;
+	float quant_error;
+
+	std::vector<bool> present_mask() const {
+		std::vector<bool> mask(nodes.size());
+		for (size_t i = 0; i < nodes.size(); ++i) mask[i] = nodes[i] != NOT_PRESENT;
+		return mask;
+	}
+
+	/** Approximate memory footprint in bytes. */
+	size_t mem_size() const { return nodes.size() * sizeof(uint8_t) + koho.size() * sizeof(float); }
+};
+
 class AsyncSom {
-	std::thread worker;
+	const Settings& _settings;
 
-	size_t _dim{};
+	/** The computations run as jobs in the shared worker pool. */
+	SomScheduler* _p_scheduler;
+	SomScheduler::Priority _priority;
+
+	const PrimaryFrameFeatures* _p_features;
+	size_t _dim;
 
 	// worker sync
-	std::condition_variable new_data_wakeup;
 	std::mutex worker_lock;
 
 	/*
 	 * Worker input protocol:
 	 *
-	 * new_data is set when a new computation is required after
-	 * wakeup to process a new dataset. Worker "eats" this flag together
+	 * new_data is set when a new computation is required and a job
+	 * is submitted to the scheduler. The job "eats" this flag together
 	 * with input data.
 	 *
 	 * terminate is set when the worker should exit.
+	 *
+	 * _generation is incremented by every new input (and restored result),
+	 * a job publishes its result only if it still matches.
+	 *
+	 * Both flags are polled by the running SOM computation, so that
+	 * obsolete work is abandoned as soon as new data arrive.
 	 */
-	bool new_data, terminate;
+	std::atomic<bool> new_data, terminate;
+	std::atomic<size_t> _generation;
+	/** Search context of the pending input. */
+	size_t _ctx_ID{ SIZE_T_ERR_VAL };
 
-	// Number of floats in features matrix
-	std::size_t _features_data_len;
 	// Number of floats in scores vector
 	std::size_t _scores_data_len;
 
-	std::vector<float> points, scores;
+	std::vector<float> scores;
 	std::vector<bool> present_mask;
 
 	/*
 	 * Worker output protocol:
 	 *
-	 * m_ready is set when mapping is filled in AND the
-	 * memory is fenced correctly.
+	 * The result is published by atomically swapping the `_result` snapshot
+	 * (use only `std::atomic_load`/`std::atomic_store` on it). m_ready is
+	 * cleared once new data arrive and set again when the result for them
+	 * is published.
 	 */
-	bool m_ready;
-	std::vector<std::vector<FrameId>> mapping;
-	std::vector<float> koho;
+	std::shared_ptr<const SomResult> _result;
+	std::atomic<bool> m_ready;
+
+	// State kept between the jobs
+	std::mt19937 _rng;
+	/** The last published codebook and the scores it was fitted to (for the warm starts). */
+	std::vector<float> _last_koho;
+	std::vector<float> _last_scores;
+
+	const bool _zoom_enabled;
 
 	const size_t width;
 	const size_t height;
 
-	static void async_som_worker(AsyncSom* parent, const Settings& _logger_settings);
+	static void async_som_job(AsyncSom* parent);
+
+	/**
+	 * Fits the child map of the `node` of the `result`, returns false if cancelled.
+	 *
+	 * Reads only the immutable parts of the `result`, the caller stores the map under its `zoom_lock`.
+	 */
+	bool fit_zoom_map(const SomResult& result, size_t node, SomZoomMap& zoom_map, std::mt19937& rng,
+	                  const SomStopPredicate& should_stop = {}) const;
 
 public:
 	AsyncSom() = delete;
@@ -80,36 +211,51 @@ public:
 
 	AsyncSom(AsyncSom&& _logger_settings) = default;
 
-	AsyncSom(const Settings& _logger_settings, size_t width, size_t height, const PrimaryFrameFeatures& fs,
-	         const ScoreModel& sc);
+	AsyncSom(const Settings& settings, SomScheduler* p_scheduler, SomScheduler::Priority priority, size_t width,
+	         size_t height, const PrimaryFrameFeatures& fs, const ScoreModel& sc);
 
-	void start_work(const PrimaryFrameFeatures& fs, const ScoreModel& sc, const float* scores_orig);
+	/**
+	 * Submits the new input; `ctx_ID` is the search context the result will belong to.
+	 *
+	 * Only the scores and the mask are copied, the job reads the features in place.
+	 */
+	void start_work(const ScoreModel& sc, const float* scores_orig, size_t ctx_ID = SIZE_T_ERR_VAL);
+
+	/** Returns the compact copy of the current result if it is ready and belongs to the `ctx_ID` context. */
+	std::optional<SomSnapshot> snapshot(size_t ctx_ID) const;
 
-	std::vector<FrameId> get_display(ScoreModel scores) const;
+	/** Publishes the stored snapshot as the current result (for the `ctx_ID` context), cancelling any computation. */
+	void restore(const SomSnapshot& snap, size_t ctx_ID, const float* scores_orig);
 
-	bool map_ready() const {
-		bool t = m_ready;
-		std::atomic_thread_fence(std::memory_order_acquire);
-		return t;
+	/** Returns the search context of the current result (`SIZE_T_ERR_VAL` if none). */
+	size_t result_ctx_ID() const {
+		auto res{ result() };
+		return res ? res->ctx_ID : SIZE_T_ERR_VAL;
 	}
-	const std::vector<FrameId>& map(size_t i) const { return mapping.at(i); }
-
-	const float* get_koho(size_t i) const { return koho.data() + i * _dim; }
-
-	size_t nearest_cluster_with_atleast(const float* vec, const std::vector<size_t>& stolen_count) const {
-		float min = std::numeric_limits<float>::max();
-		size_t res = 0;
-		for (size_t i = 0; i < mapping.size(); ++i) {
-			if (mapping[i].size() > stolen_count[i]) {
-				float tmp = d_sqeucl(koho.data() + _dim * i, vec, _dim);
-				if (min > tmp) {
-					min = tmp;
-					res = i;
-				}
-			}
-		}
 
-		return res;
+	/** Returns the latest published result (may be null), it stays valid as long as the caller holds it. */
+	std::shared_ptr<const SomResult> result() const { return std::atomic_load(&_result); }
+
+	std::vector<FrameId> get_display(const ScoreModel& scores) const;
+
+	/**
+	 * Returns the display of the child map of the node the (present) frame belongs to, fitting it first if needed.
+	 *
+	 * Empty if the frame is not mapped by the current map.
+	 */
+	std::vector<FrameId> get_zoom_display(FrameId frame_ID, const ScoreModel& scores) const;
+
+	/** True if the published result matches the latest data. */
+	bool map_ready() const { return m_ready.load(); }
+	/** Milliseconds it took to fit the current map (valid only if \ref map_ready). */
+	size_t fit_duration_ms() const {
+		auto res{ result() };
+		return res ? res->fit_duration_ms : 0;
+	}
+	/** Estimated quantization error of the current map (valid only if \ref map_ready, negative if not estimated). */
+	float quantization_error() const {
+		auto res{ result() };
+		return res ? res->quant_error.load() : -1.0F;
 	}
 };
 
@@ -0,0 +1,84 @@
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2021 Frantisek Mejzlik <frankmejzlik@protonmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Vesely <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "som-history.h"
+
+#include "common.h"
+
+using namespace sh;
+
+size_t SomHistory::entry_size(const Entry& entry) {
+	size_t res{ 0 };
+	for (auto&& snap : entry)
+		if (snap.has_value()) res += snap->mem_size();
+	return res;
+}
+
+void SomHistory::store(size_t ctx_ID, Entry&& entry) {
+	std::lock_guard lck{ _lock };
+
+	auto it{ _entries.find(ctx_ID) };
+	if (it != _entries.end()) {
+		_size -= entry_size(it->second.first);
+		_lru.erase(it->second.second);
+		_entries.erase(it);
+	}
+
+	const size_t size{ entry_size(entry) };
+	if (size > _max_bytes) return;
+
+	_lru.push_front(ctx_ID);
+	_entries.emplace(ctx_ID, std::make_pair(std::move(entry), _lru.begin()));
+	_size += size;
+
+	evict_over_budget();
+	SHLOG_D("Stored SOM maps of context " << ctx_ID << ", " << _entries.size() << " contexts, " << _size << " B");
+}
+
+std::optional<SomHistory::Entry> SomHistory::find(size_t ctx_ID) {
+	std::lock_guard lck{ _lock };
+
+	auto it{ _entries.find(ctx_ID) };
+	if (it == _entries.end()) return std::nullopt;
+
+	_lru.splice(_lru.begin(), _lru, it->second.second);
+	return it->second.first;
+}
+
+bool SomHistory::contains(size_t ctx_ID) const {
+	std::lock_guard lck{ _lock };
+	return _entries.count(ctx_ID) > 0;
+}
+
+void SomHistory::clear() {
+	std::lock_guard lck{ _lock };
+	_lru.clear();
+	_entries.clear();
+	_size = 0;
+}
+
+void SomHistory::evict_over_budget() {
+	while (_size > _max_bytes && !_lru.empty()) {
+		auto it{ _entries.find(_lru.back()) };
+		_size -= entry_size(it->second.first);
+		_entries.erase(it);
+		_lru.pop_back();
+	}
+}
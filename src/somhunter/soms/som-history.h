@@ -0,0 +1,77 @@
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2021 Frantisek Mejzlik <frankmejzlik@protonmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Vesely <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SOM_HISTORY_H_
+#define SOM_HISTORY_H_
+
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+// ---
+#include "async-som.h"
+
+namespace sh {
+
+/**
+ * SOM maps of the search contexts in the user's history.
+ *
+ * Switching back to a context restores its maps instead of refitting them.
+ * The total size of the stored snapshots is bounded, the least recently
+ * used contexts are dropped first.
+ */
+class SomHistory {
+public:
+	/** Snapshots of all the SOMs of one context: the main one first, then the temporal ones. */
+	using Entry = std::vector<std::optional<SomSnapshot>>;
+
+	SomHistory() = delete;
+	SomHistory(size_t max_bytes) : _max_bytes{ max_bytes } {};
+
+	/** Stores (or replaces) the maps of the `ctx_ID` context, evicting the old ones if over the budget. */
+	void store(size_t ctx_ID, Entry&& entry);
+
+	/** Returns the maps of the `ctx_ID` context (if stored) and marks them as recently used. */
+	std::optional<Entry> find(size_t ctx_ID);
+
+	bool contains(size_t ctx_ID) const;
+
+	void clear();
+
+	size_t mem_size() const { return _size; }
+
+private:
+	static size_t entry_size(const Entry& entry);
+
+	void evict_over_budget();
+
+	const size_t _max_bytes;
+
+	mutable std::mutex _lock;
+	/** Context IDs from the most recently used one. */
+	std::list<size_t> _lru;
+	std::unordered_map<size_t, std::pair<Entry, std::list<size_t>::iterator>> _entries;
+	size_t _size{ 0 };
+};
+
+};  // namespace sh
+
+#endif  // SOM_HISTORY_H_
@@ -0,0 +1,128 @@
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2021 Frantisek Mejzlik <frankmejzlik@protonmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Vesely <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "som-scheduler.h"
+
+#include <algorithm>
+
+#include "common.h"
+
+using namespace sh;
+
+SomScheduler::SomScheduler(size_t num_workers) {
+	const size_t num_cores{ std::max<size_t>(1, std::thread::hardware_concurrency()) };
+	if (num_workers == 0) {
+		num_workers = std::min<size_t>(MAX_NUM_TEMP_WORKERS, num_cores);
+	}
+	_main_parallelism = std::max<size_t>(1, num_cores / num_workers);
+
+	SHLOG_D("Starting " << num_workers << " SOM workers...");
+	for (size_t i = 0; i < num_workers; ++i) _workers.emplace_back(&SomScheduler::worker_loop, this);
+}
+
+SomScheduler::~SomScheduler() noexcept {
+	SHLOG_D("Requesting SOM workers termination...");
+	{
+		std::unique_lock lck(_lock);
+		_terminate = true;
+	}
+	_wakeup.notify_all();
+
+	for (auto&& w : _workers) w.join();
+	SHLOG_D("SOM workers terminated.");
+}
+
+void SomScheduler::submit(const void* owner, Priority priority, Job job) {
+	{
+		std::unique_lock lck(_lock);
+
+		PendingJob pending{ priority, _next_seq++, Clock::now(), std::move(job) };
+		bool inserted = _pending.insert_or_assign(owner, std::move(pending)).second;
+		if (!inserted) ++_num_coalesced;
+
+		++_num_submitted;
+		_max_queue_depth = std::max(_max_queue_depth, _pending.size());
+	}
+	_wakeup.notify_all();
+}
+
+void SomScheduler::cancel(const void* owner) {
+	std::unique_lock lck(_lock);
+	_pending.erase(owner);
+	_wakeup.wait(lck, [this, owner]() { return _running.count(owner) == 0; });
+}
+
+SomScheduler::Stats SomScheduler::stats() const {
+	std::unique_lock lck(_lock);
+
+	auto to_ms = [](Clock::duration d) { return std::chrono::duration<float, std::milli>(d).count(); };
+	return Stats{ _pending.size(),
+		          _max_queue_depth,
+		          _num_submitted,
+		          _num_coalesced,
+		          _num_finished,
+		          _num_started > 0 ? to_ms(_total_wait) / _num_started : 0.0F,
+		          to_ms(_max_wait) };
+}
+
+std::map<const void*, SomScheduler::PendingJob>::iterator SomScheduler::pick_next() {
+	auto best = _pending.end();
+	for (auto it = _pending.begin(); it != _pending.end(); ++it) {
+		if (_running.count(it->first) > 0) continue;
+
+		if (best == _pending.end() || it->second.priority < best->second.priority ||
+		    (it->second.priority == best->second.priority && it->second.seq > best->second.seq)) {
+			best = it;
+		}
+	}
+	return best;
+}
+
+void SomScheduler::worker_loop() {
+	std::unique_lock lck(_lock);
+	while (!_terminate) {
+		auto it = pick_next();
+		if (it == _pending.end()) {
+			_wakeup.wait(lck);
+			continue;
+		}
+
+		const void* owner = it->first;
+		Job job = std::move(it->second.job);
+
+		auto wait = Clock::now() - it->second.submitted;
+		_total_wait += wait;
+		_max_wait = std::max(_max_wait, wait);
+		++_num_started;
+
+		_pending.erase(it);
+		_running.insert(owner);
+
+		lck.unlock();
+		job();
+		lck.lock();
+
+		_running.erase(owner);
+		++_num_finished;
+
+		// Someone may wait for this owner (a worker with its newer job or `cancel`)
+		_wakeup.notify_all();
+	}
+}
@@ -0,0 +1,134 @@
+/* This file is part of SOMHunter.
+ *
+ * Copyright (C) 2021 Frantisek Mejzlik <frankmejzlik@protonmail.com>
+ *                    Mirek Kratochvil <exa.exa@gmail.com>
+ *                    Patrik Vesely <prtrikvesely@gmail.com>
+ *
+ * SOMHunter is free software: you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free
+ * Software Foundation, either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * SOMHunter is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+ * FOR A PARTICULAR PURPOSE.  See the GNU General Public License for more
+ * details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * SOMHunter. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef SOM_SCHEDULER_H_
+#define SOM_SCHEDULER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace sh {
+
+/**
+ * Fixed pool of workers shared by all the SOMs of all the users.
+ *
+ * Each job belongs to an owner (one SOM of one user). An owner has at most one
+ * pending job; submitting a new one replaces (coalesces) the pending one, since
+ * only the newest data matter. Jobs of one owner never run concurrently.
+ *
+ * Pending jobs are served by the priority class first and the newest first
+ * within the class.
+ */
+class SomScheduler {
+public:
+	/** Priority classes of the jobs, lower ones are served first. */
+	enum class Priority { MainDisplay = 0, Relocation = 1 };
+
+	using Job = std::function<void()>;
+
+	struct Stats {
+		/** Number of the currently pending jobs. */
+		size_t queue_depth;
+		size_t max_queue_depth;
+
+		size_t num_submitted;
+		/** Number of the pending jobs replaced by newer ones before they started. */
+		size_t num_coalesced;
+		size_t num_finished;
+
+		/** Time between the submission and the start of the jobs. */
+		float avg_wait_ms;
+		float max_wait_ms;
+	};
+
+	SomScheduler() = delete;
+	/** Starts the pool with `num_workers` threads (0 means the default count). */
+	SomScheduler(size_t num_workers);
+	~SomScheduler() noexcept;
+
+	SomScheduler(const SomScheduler&) = delete;
+	SomScheduler& operator=(const SomScheduler&) = delete;
+
+	/** Enqueues the job of the `owner`, replacing its pending job (if any). */
+	void submit(const void* owner, Priority priority, Job job);
+
+	/** Drops the pending job of the `owner` and waits until its running job (if any) finishes. */
+	void cancel(const void* owner);
+
+	Stats stats() const;
+
+	size_t num_workers() const { return _workers.size(); }
+
+	/**
+	 * Number of threads one job of the `priority` may use for its data-parallel parts.
+	 *
+	 * The main display jobs get an equal share of the cores per worker, the lower
+	 * priorities run on their worker thread only; all the busy workers together
+	 * thus never use more threads than there are cores.
+	 */
+	size_t parallelism(Priority priority) const { return priority == Priority::MainDisplay ? _main_parallelism : 1; }
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	struct PendingJob {
+		Priority priority;
+		size_t seq;
+		Clock::time_point submitted;
+		Job job;
+	};
+
+	void worker_loop();
+
+	/** Returns the pending job to be run next (skipping the running owners) or `_pending.end()`. */
+	std::map<const void*, PendingJob>::iterator pick_next();
+
+	mutable std::mutex _lock;
+	/** Signals a new job, a finished job or the termination. */
+	std::condition_variable _wakeup;
+
+	std::map<const void*, PendingJob> _pending;
+	std::set<const void*> _running;
+	size_t _next_seq{ 0 };
+	bool _terminate{ false };
+
+	// Metrics
+	size_t _max_queue_depth{ 0 };
+	size_t _num_submitted{ 0 };
+	size_t _num_coalesced{ 0 };
+	size_t _num_started{ 0 };
+	size_t _num_finished{ 0 };
+	Clock::duration _total_wait{ 0 };
+	Clock::duration _max_wait{ 0 };
+
+	size_t _main_parallelism{ 1 };
+
+	std::vector<std::thread> _workers;
+};
+
+};  // namespace sh
+
+#endif  // SOM_SCHEDULER_H_
@@ -20,7 +20,11 @@
 
 #include "som.h"
 
+#include <algorithm>
 #include <cmath>
+#include <execution>
+#include <limits>
+#include <numeric>
 
 #include "common.h"
 #include "distances.hpp"
@@ -99,10 +103,14 @@ heap_down(dist_id *heap, size_t start, size_t lim)
 }
 #endif
 
-void fit_SOM(size_t /*n*/, size_t k, size_t dim, size_t niter, const std::vector<float>& points,
-             std::vector<float>& koho, const std::vector<float>& nhbrdist, const float alphasA[2],
-             const float radiiA[2], const float alphasB[2], const float radiiB[2], const std::vector<float>& scores,
-             const std::vector<bool>& /*present_mask*/, std::mt19937& rng) {
+// how often (in iterations/points) the stop predicate & the clock are polled
+static const size_t fit_poll_period = 256;
+static const size_t map_poll_period = 4096;
+
+bool fit_SOM(size_t /*n*/, size_t k, size_t dim, size_t niter, const float* points, std::vector<float>& koho,
+             const std::vector<float>& nhbrdist, const float alphasA[2], const float radiiA[2], const float alphasB[2],
+             const float radiiB[2], const std::vector<float>& scores, const std::vector<bool>& /*present_mask*/,
+             std::mt19937& rng, const SomStopPredicate& should_stop, std::chrono::milliseconds time_budget) {
 	SHLOG_D("SOM fitting...");
 	std::discrete_distribution<size_t> random(scores.begin(), scores.end());
 
@@ -115,15 +123,37 @@ void fit_SOM(size_t /*n*/, size_t k, size_t dim, size_t niter, const std::vector
 	float thresholdBDiff = radiiB[1] - radiiB[0];
 	float alphaBDiff = alphasB[1] - alphasB[0];
 
+	const bool anytime = time_budget.count() > 0;
+	const auto fit_start = std::chrono::steady_clock::now();
+	float rtime = 0.0F;
+
 	for (size_t iter = 0; iter < niter; ++iter) {
+		if (iter % fit_poll_period == 0) {
+			if (should_stop && should_stop()) {
+				SHLOG_D("SOM fitting cancelled after " << iter << " iterations.");
+				return false;
+			}
+
+			if (anytime) {
+				auto elapsed = std::chrono::steady_clock::now() - fit_start;
+				rtime = std::chrono::duration<float>(elapsed) / time_budget;
+
+				// Time is up, the map is annealed
+				if (rtime >= 1.0F) {
+					SHLOG_D("SOM time budget exhausted after " << iter << " iterations.");
+					break;
+				}
+			}
+		}
+
 		size_t point = random(rng);
-		float riter = iter / float(niter);
+		float riter = std::max(iter / float(niter), rtime);
 
 		size_t nearest = 0;
 		{
-			float nearestd = DIST_FUNC(points.data() + dim * point, koho.data(), dim);
+			float nearestd = DIST_FUNC(points + dim * point, koho.data(), dim);
 			for (size_t i = 1; i < k; ++i) {
-				float tmp = DIST_FUNC(points.data() + dim * point, koho.data() + dim * i, dim);
+				float tmp = DIST_FUNC(points + dim * point, koho.data() + dim * i, dim);
 				if (tmp < nearestd) {
 					nearest = i;
 					nearestd = tmp;
@@ -151,27 +181,290 @@ void fit_SOM(size_t /*n*/, size_t k, size_t dim, size_t niter, const std::vector
 		}
 	}
 	SHLOG_D("SOM fitted.");
+	return true;
 }
 
-/* this serves for classification into small clusters */
-void map_points_to_kohos(size_t start, size_t end, size_t k, size_t dim, const std::vector<float>& points,
-                         const std::vector<float>& koho, std::vector<size_t>& mapping,
-                         const std::vector<bool>& present_mask) {
-	for (size_t point = start; point < end; ++point) {
-		if (present_mask[point]) {
-			size_t nearest = 0;
-			float nearestd = DIST_FUNC(points.data() + dim * point, koho.data(), dim);
-			for (size_t i = 1; i < k; ++i) {
-				float tmp = DIST_FUNC(points.data() + dim * point, koho.data() + dim * i, dim);
-				if (tmp < nearestd) {
-					nearest = i;
-					nearestd = tmp;
-				}
+static size_t nearest_koho(const float* point, size_t k, size_t dim, const std::vector<float>& koho, float& nearestd) {
+	size_t nearest = 0;
+	nearestd = DIST_FUNC(point, koho.data(), dim);
+	for (size_t i = 1; i < k; ++i) {
+		float tmp = DIST_FUNC(point, koho.data() + dim * i, dim);
+		if (tmp < nearestd) {
+			nearest = i;
+			nearestd = tmp;
+		}
+	}
+	return nearest;
+}
+
+bool fit_SOM_batch(size_t k, size_t dim, size_t nepochs, size_t batch_size, const float* points,
+                   std::vector<float>& koho, const std::vector<float>& nhbrdist, const float radii[2],
+                   const std::vector<float>& scores, std::mt19937& rng, const SomStopPredicate& should_stop,
+                   std::chrono::milliseconds time_budget, size_t parallelism) {
+	SHLOG_D("Batch SOM fitting...");
+	std::discrete_distribution<size_t> random(scores.begin(), scores.end());
+
+	// All-zero codebook would collapse into a single node, start from the data instead
+	if (std::all_of(koho.begin(), koho.end(), [](float x) { return x == 0.0F; })) {
+		for (size_t i = 0; i < k; ++i) {
+			size_t point = random(rng);
+			std::copy_n(points + dim * point, dim, koho.data() + dim * i);
+		}
+	}
+
+	const size_t n_chunks = std::max<size_t>(1, parallelism);
+	std::vector<size_t> sample(batch_size);
+
+	// Per-chunk partial sums of the points assigned to each node and their counts
+	std::vector<std::vector<float>> part_sums(n_chunks, std::vector<float>(k * dim));
+	std::vector<std::vector<float>> part_counts(n_chunks, std::vector<float>(k));
+
+	std::vector<float> sums(k * dim);
+	std::vector<float> counts(k);
+	std::vector<float> weights(k * k);
+
+	const bool anytime = time_budget.count() > 0;
+	const auto fit_start = std::chrono::steady_clock::now();
+	float rtime = 0.0F;
+
+	for (size_t epoch = 0; epoch < nepochs; ++epoch) {
+		if (should_stop && should_stop()) {
+			SHLOG_D("Batch SOM fitting cancelled after " << epoch << " epochs.");
+			return false;
+		}
+
+		if (anytime) {
+			auto elapsed = std::chrono::steady_clock::now() - fit_start;
+			rtime = std::chrono::duration<float>(elapsed) / time_budget;
+
+			if (rtime >= 1.0F) {
+				SHLOG_D("SOM time budget exhausted after " << epoch << " epochs.");
+				break;
+			}
+		}
+
+		for (auto&& s : sample) s = random(rng);
+
+		// BMU assignment of the sample is data-parallel...
+		auto worker = [&](size_t id) {
+			auto& ps{ part_sums[id] };
+			auto& pc{ part_counts[id] };
+			std::fill(ps.begin(), ps.end(), 0.0F);
+			std::fill(pc.begin(), pc.end(), 0.0F);
+
+			size_t start = id * batch_size / n_chunks;
+			size_t end = (id + 1) * batch_size / n_chunks;
+			for (size_t i = start; i < end; ++i) {
+				const float* point = points + dim * sample[i];
+				float d;
+				size_t nearest = nearest_koho(point, k, dim, koho, d);
+
+				pc[nearest] += 1.0F;
+				for (size_t j = 0; j < dim; ++j) ps[j + nearest * dim] += point[j];
+			}
+		};
+
+		std::for_each(std::execution::par, ioterable<size_t>(0), ioterable<size_t>(n_chunks), worker);
+
+		// ... and the codebook update is a reduction over the partial results
+		std::fill(sums.begin(), sums.end(), 0.0F);
+		std::fill(counts.begin(), counts.end(), 0.0F);
+		for (size_t t = 0; t < n_chunks; ++t) {
+			for (size_t i = 0; i < k * dim; ++i) sums[i] += part_sums[t][i];
+			for (size_t i = 0; i < k; ++i) counts[i] += part_counts[t][i];
+		}
+
+		float riter = nepochs > 1 ? std::max(epoch / float(nepochs - 1), rtime) : 1.0F;
+		float radius = radii[0] + riter * (radii[1] - radii[0]);
+		float denom = 2 * radius * radius;
+		for (size_t i = 0; i < k * k; ++i) weights[i] = expf(-nhbrdist[i] * nhbrdist[i] / denom);
+
+		for (size_t i = 0; i < k; ++i) {
+			float* node = koho.data() + dim * i;
+			float total = 0.0F;
+			for (size_t c = 0; c < k; ++c) total += weights[c + k * i] * counts[c];
+
+			// Node without any points in its neighbourhood keeps its position
+			if (total < koho_gravity) continue;
+
+			std::fill_n(node, dim, 0.0F);
+			for (size_t c = 0; c < k; ++c) {
+				float w = weights[c + k * i];
+				if (counts[c] == 0.0F) continue;
+				for (size_t j = 0; j < dim; ++j) node[j] += w * sums[j + c * dim];
+			}
+			for (size_t j = 0; j < dim; ++j) node[j] /= total;
+		}
+	}
+	SHLOG_D("Batch SOM fitted.");
+	return true;
+}
+
+float quantization_error(size_t k, size_t dim, size_t sample_size, const float* points, const std::vector<float>& koho,
+                         const std::vector<float>& scores, std::mt19937& rng) {
+	std::discrete_distribution<size_t> random(scores.begin(), scores.end());
+
+	float sum = 0.0F;
+	for (size_t i = 0; i < sample_size; ++i) {
+		float d;
+		nearest_koho(points + dim * random(rng), k, dim, koho, d);
+		sum += UNDIST_FUNC(d);
+	}
+
+	return sample_size > 0 ? sum / sample_size : 0.0F;
+}
+
+float top_k_divergence(const std::vector<float>& scores, const std::vector<float>& prev_scores, size_t top_k) {
+	top_k = std::min(top_k, scores.size());
+	if (top_k == 0 || prev_scores.size() != scores.size()) return std::numeric_limits<float>::infinity();
+
+	std::vector<size_t> ids(scores.size());
+	std::iota(ids.begin(), ids.end(), 0);
+	std::nth_element(ids.begin(), ids.begin() + (top_k - 1), ids.end(),
+	                 [&scores](size_t a, size_t b) { return scores[a] > scores[b]; });
+
+	float sum_p = 0.0F;
+	float sum_q = 0.0F;
+	for (size_t i = 0; i < top_k; ++i) {
+		sum_p += scores[ids[i]];
+		sum_q += prev_scores[ids[i]];
+	}
+	if (sum_p <= 0.0F || sum_q <= 0.0F) return std::numeric_limits<float>::infinity();
+
+	float kl = 0.0F;
+	for (size_t i = 0; i < top_k; ++i) {
+		float p = scores[ids[i]] / sum_p;
+		float q = prev_scores[ids[i]] / sum_q;
+		if (p > 0.0F) kl += p * logf(p / (q + zero_avoidance));
+	}
+	return std::max(kl, 0.0F);
+}
+
+std::vector<size_t> present_points(const std::vector<bool>& present_mask) {
+	std::vector<size_t> ids(present_mask.size());
+
+	// Branchless compaction, the slot is overwritten unless the point is present
+	size_t n = 0;
+	for (size_t i = 0; i < present_mask.size(); ++i) {
+		ids[n] = i;
+		n += size_t(present_mask[i]);
+	}
+
+	ids.resize(n);
+	return ids;
+}
+
+/** Number of points processed at once by the mapping kernel. */
+static const size_t map_block_points = 4;
+/** Number of SOM nodes processed at once by the mapping kernel (two SSE registers). */
+static const size_t map_block_nodes = 8;
+
+/**
+ * Computes `‖k‖² − 2p·k` for the block of points and all the (padded) nodes.
+ *
+ * The nodes are stored dimension-major in `kohoT`, so that each step of the kernel
+ * loads `map_block_nodes` consecutive coordinates and reuses them for all the points.
+ */
+static void block_distances(const float* const ps[map_block_points], const float* kohoT, const float* norms,
+                            size_t kp, size_t dim, float* out) {
+	for (size_t n = 0; n < kp; n += map_block_nodes) {
+#ifdef USE_INTRINS
+		__m128 acc[map_block_points][2];
+		for (size_t p = 0; p < map_block_points; ++p) acc[p][0] = acc[p][1] = _mm_setzero_ps();
+
+		for (size_t j = 0; j < dim; ++j) {
+			__m128 k0 = _mm_loadu_ps(kohoT + j * kp + n);
+			__m128 k1 = _mm_loadu_ps(kohoT + j * kp + n + 4);
+			for (size_t p = 0; p < map_block_points; ++p) {
+				__m128 pj = _mm_set1_ps(ps[p][j]);
+				acc[p][0] = _mm_add_ps(acc[p][0], _mm_mul_ps(pj, k0));
+				acc[p][1] = _mm_add_ps(acc[p][1], _mm_mul_ps(pj, k1));
 			}
+		}
 
-			mapping[point] = nearest;
+		const __m128 two = _mm_set1_ps(2.0F);
+		const __m128 n0 = _mm_loadu_ps(norms + n);
+		const __m128 n1 = _mm_loadu_ps(norms + n + 4);
+		for (size_t p = 0; p < map_block_points; ++p) {
+			_mm_storeu_ps(out + p * kp + n, _mm_sub_ps(n0, _mm_mul_ps(two, acc[p][0])));
+			_mm_storeu_ps(out + p * kp + n + 4, _mm_sub_ps(n1, _mm_mul_ps(two, acc[p][1])));
 		}
+#else
+		float acc[map_block_points][map_block_nodes] = {};
+		for (size_t j = 0; j < dim; ++j)
+			for (size_t p = 0; p < map_block_points; ++p)
+				for (size_t i = 0; i < map_block_nodes; ++i) acc[p][i] += ps[p][j] * kohoT[j * kp + n + i];
+
+		for (size_t p = 0; p < map_block_points; ++p)
+			for (size_t i = 0; i < map_block_nodes; ++i) out[p * kp + n + i] = norms[n + i] - 2 * acc[p][i];
+#endif
+	}
+}
+
+/** Index of the smallest of the `kp` (multiple of 4) values, the first one on ties. */
+static size_t block_argmin(const float* d, size_t kp) {
+#ifdef USE_INTRINS
+	// Lane-wise running minimum together with its index (exactly representable in floats)
+	__m128 minv = _mm_loadu_ps(d);
+	__m128 idx = _mm_set_ps(3.0F, 2.0F, 1.0F, 0.0F);
+	__m128 mini = idx;
+	const __m128 four = _mm_set1_ps(4.0F);
+	for (size_t i = 4; i < kp; i += 4) {
+		idx = _mm_add_ps(idx, four);
+		__m128 v = _mm_loadu_ps(d + i);
+		__m128 lt = _mm_cmplt_ps(v, minv);
+		minv = _mm_min_ps(v, minv);
+		mini = _mm_or_ps(_mm_and_ps(lt, idx), _mm_andnot_ps(lt, mini));
+	}
+
+	float vals[4], ids[4];
+	_mm_storeu_ps(vals, minv);
+	_mm_storeu_ps(ids, mini);
+	size_t best = 0;
+	for (size_t l = 1; l < 4; ++l)
+		if (vals[l] < vals[best] || (vals[l] == vals[best] && ids[l] < ids[best])) best = l;
+	return size_t(ids[best]);
+#else
+	return size_t(std::min_element(d, d + kp) - d);
+#endif
+}
+
+/* this serves for classification into small clusters */
+bool map_points_to_kohos(const std::vector<size_t>& point_ids, size_t start, size_t end, size_t k, size_t dim,
+                         const float* points, const std::vector<float>& koho, std::vector<size_t>& mapping,
+                         const SomStopPredicate& should_stop) {
+	if (start >= end) return true;
+
+	// Nodes padded to the kernel block, the padding ones never win
+	const size_t kp = (k + map_block_nodes - 1) / map_block_nodes * map_block_nodes;
+	std::vector<float> kohoT(kp * dim, 0.0F);
+	std::vector<float> norms(kp, std::numeric_limits<float>::max());
+	for (size_t i = 0; i < k; ++i) {
+		const float* node = koho.data() + dim * i;
+#ifdef EUCL
+		norms[i] = d_dot_normalized(node, node, dim);
+#else
+		norms[i] = 0.0F;
+#endif
+		for (size_t j = 0; j < dim; ++j) kohoT[j * kp + i] = node[j];
+	}
+
+	// ‖p‖² is the same for all the nodes, the argmin of ‖p‖² − 2p·k + ‖k‖² does not need it
+	std::vector<float> dists(map_block_points * kp);
+	for (size_t b = start; b < end; b += map_block_points) {
+		if ((b - start) % map_poll_period == 0 && should_stop && should_stop()) return false;
+
+		// The last block is completed by repeating its last point
+		const size_t np = std::min(map_block_points, end - b);
+		const float* ps[map_block_points];
+		for (size_t p = 0; p < map_block_points; ++p)
+			ps[p] = points + dim * point_ids[b + std::min(p, np - 1)];
+
+		block_distances(ps, kohoT.data(), norms.data(), kp, dim, dists.data());
+		for (size_t p = 0; p < np; ++p) mapping[point_ids[b + p]] = block_argmin(dists.data() + p * kp, kp);
 	}
+
+	return true;
 }
 
 };  // namespace sh
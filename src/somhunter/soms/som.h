@@ -21,18 +21,79 @@
 #ifndef embedsom_h
 #define embedsom_h
 
+#include <chrono>
+#include <functional>
 #include <random>
 #include <vector>
 
 namespace sh {
-void fit_SOM(size_t _size, size_t k, size_t dim, size_t niter, const std::vector<float>& points,
-             std::vector<float>& koho, const std::vector<float>& nhbrdist, const float alphasA[2],
-             const float radiiA[2], const float alphasB[2], const float radiiB[2], const std::vector<float>& scores,
-             const std::vector<bool>& present_mask, std::mt19937& rng);
-
-void map_points_to_kohos(size_t start, size_t end, size_t k, size_t dim, const std::vector<float>& points,
-                         const std::vector<float>& koho, std::vector<size_t>& mapping,
-                         const std::vector<bool>& present_mask);
+/**
+ * Predicate the SOM functions poll while running; once it returns `true`,
+ * the computation is abandoned as soon as possible.
+ */
+using SomStopPredicate = std::function<bool()>;
+
+/**
+ * Fits the SOM codebook `koho` to the `points` sampled w.r.t. the `scores`.
+ *
+ * The `points` (here and below) are the rows of a row-major matrix with `dim` columns.
+ *
+ * If `time_budget` is non-zero, the function runs in the "anytime" mode: the
+ * annealing schedule is driven by the elapsed time (or the iteration count,
+ * whichever is further) so that a fully annealed map is ready within the budget.
+ *
+ * \return False if the fitting was cancelled by `should_stop`.
+ */
+bool fit_SOM(size_t _size, size_t k, size_t dim, size_t niter, const float* points, std::vector<float>& koho,
+             const std::vector<float>& nhbrdist, const float alphasA[2], const float radiiA[2], const float alphasB[2],
+             const float radiiB[2], const std::vector<float>& scores, const std::vector<bool>& present_mask,
+             std::mt19937& rng, const SomStopPredicate& should_stop = {},
+             std::chrono::milliseconds time_budget = std::chrono::milliseconds{ 0 });
+
+/**
+ * Fits the SOM codebook `koho` by the batch SOM algorithm.
+ *
+ * Each epoch draws `batch_size` points w.r.t. the `scores`, assigns them to
+ * their nearest nodes in `parallelism` parallel chunks and then replaces every
+ * node by the neighbourhood-weighted mean of the assigned points. The neighbourhood
+ * radius shrinks from `radii[0]` to `radii[1]` over the epochs (or over the
+ * `time_budget`). An all-zero codebook is initialized from the sampled points first.
+ *
+ * \return False if the fitting was cancelled by `should_stop`.
+ */
+bool fit_SOM_batch(size_t k, size_t dim, size_t nepochs, size_t batch_size, const float* points,
+                   std::vector<float>& koho, const std::vector<float>& nhbrdist, const float radii[2],
+                   const std::vector<float>& scores, std::mt19937& rng, const SomStopPredicate& should_stop = {},
+                   std::chrono::milliseconds time_budget = std::chrono::milliseconds{ 0 }, size_t parallelism = 1);
+
+/**
+ * Estimates the quantization error of the codebook, i.e. the mean distance of
+ * a point to its nearest node, from `sample_size` points drawn w.r.t. the `scores`.
+ */
+float quantization_error(size_t k, size_t dim, size_t sample_size, const float* points, const std::vector<float>& koho,
+                         const std::vector<float>& scores, std::mt19937& rng);
+
+/**
+ * Measures how much the score distribution changed: the KL divergence of the
+ * `prev_scores` from the `scores`, both restricted to and normalized over the
+ * `top_k` frames with the highest `scores`.
+ */
+float top_k_divergence(const std::vector<float>& scores, const std::vector<float>& prev_scores, size_t top_k);
+
+/** Returns the (ascending) indices of the points that are set in the `present_mask`. */
+std::vector<size_t> present_points(const std::vector<bool>& present_mask);
+
+/**
+ * Assigns the points `point_ids[start, end)` to their nearest SOM node.
+ *
+ * The distances are computed as a blocked product of the points with the
+ * codebook, using the precomputed squared norms of the nodes.
+ *
+ * \return False if the mapping was cancelled by `should_stop`.
+ */
+bool map_points_to_kohos(const std::vector<size_t>& point_ids, size_t start, size_t end, size_t k, size_t dim,
+                         const float* points, const std::vector<float>& koho, std::vector<size_t>& mapping,
+                         const SomStopPredicate& should_stop = {});
 
 };  // namespace sh
 #endif
@@ -21,10 +21,15 @@
 
 #include "tests.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <filesystem>
 #include <map>
 #include <stack>
 #include <string>
+#include <thread>
 // ---
 #include <nlohmann/json.hpp>
 // ---
@@ -63,6 +68,7 @@ void TESTER_Somhunter::run_all_tests(const std::string &cfg_fpth) {
 	TEST_bookmark_frames(core);
 	TEST_autocomplete_keywords(core);
 	TEST_rescore(core);
+	TEST_score_cache();
 	TEST_canvas_queries(core);
 
 #ifdef TEST_FILTERS
@@ -202,6 +208,53 @@ void TESTER_Somhunter::TEST_autocomplete_keywords(Somhunter &core) {
 	ac_res = core.autocomplete_keywords("", 10);
 	do_assert(ac_res.empty(), "Results should be empty!");
 
+	/*
+	 * `KeywordIndex` order (must match the former linear search)
+	 */
+	auto make_kw = [](KeywordId ID, SynsetStrings strs) {
+		Keyword kw{};
+		kw.kw_ID = ID;
+		kw.synset_strs = std::move(strs);
+		return kw;
+	};
+	std::vector<Keyword> kws{ make_kw(0, { "hotdog", "dog" }), make_kw(1, { "cat" }),
+		                      make_kw(2, { "category", "bobcat" }), make_kw(3, { "scatter", "catalog" }) };
+
+	// The prefix matches sorted, then the inner matches in the order of the keywords
+	auto linear_find = [&kws](const std::string &search, size_t num_limit) {
+		KwSearchIds prefix;
+		KwSearchIds inner;
+		for (auto &&kw : kws) {
+			for (size_t j{ 0 }; j < kw.synset_strs.size(); ++j) {
+				auto f{ kw.synset_strs[j].find(search) };
+				if (f == 0)
+					prefix.emplace_back(kw.kw_ID, j);
+				else if (f != std::string::npos)
+					inner.emplace_back(kw.kw_ID, j);
+			}
+		}
+		std::sort(prefix.begin(), prefix.end(), [&kws](const KwSearchId &a, const KwSearchId &b) {
+			return kws[a.first].synset_strs[a.second] < kws[b.first].synset_strs[b.second];
+		});
+		prefix.insert(prefix.end(), inner.begin(), inner.end());
+		if (prefix.size() > num_limit) prefix.resize(num_limit);
+		return prefix;
+	};
+
+	KeywordIndex index{ kws };
+
+	// The exact match, the prefix matches ("catalog" < "category") and the substring-only matches
+	KwSearchIds expected{ { 1, 0 }, { 3, 1 }, { 2, 0 }, { 2, 1 }, { 3, 0 } };
+	do_assert(index.find("cat", 10) == expected, "Incorrect keyword index order!");
+	do_assert(index.find("cat", 2) == KwSearchIds(expected.begin(), expected.begin() + 2),
+	          "Incorrect keyword index limit!");
+
+	for (auto &&q : { "cat", "dog", "hotdog", "o", "at", "b", "g", "x" }) {
+		for (size_t limit : { 1, 2, 10 }) {
+			do_assert(index.find(q, limit) == linear_find(q, limit), "Keyword index differs from the linear search!");
+		}
+	}
+
 	SHLOG("\t Testing `Somhunter::autocomplete_keywords` finished.");
 }
 
@@ -305,6 +358,90 @@ void TESTER_Somhunter::TEST_rescore(Somhunter &core) {
 	SHLOG("\t Testing `Somhunter::TEST_rescore` finished.");
 }
 
+void TESTER_Somhunter::TEST_score_cache() {
+	SHLOG("\t Testing `ScoreCache`...");
+
+	constexpr size_t size{ 1000 };
+	auto fresh = [](float seed) {
+		std::vector<float> v(size);
+		for (size_t i{ 0 }; i < size; ++i) v[i] = std::sin(seed * float(i)) * 10.0F + float(i) / 7.0F;
+		return v;
+	};
+
+	/*
+	 * #1 A hit returns the same as a fresh computation
+	 */
+	{
+		ScoreCache cache{ 1 << 20, false };
+		std::vector<float> computed{ fresh(1.0F) };
+		std::vector<float> out(size);
+
+		auto res{ cache.find_or_compute("w2vv/primary/dog", out.data(), size, [&]() { return computed.data(); }) };
+		do_assert(res == ScoreCache::Lookup::Computed, "The first lookup SHOULD compute.");
+
+		res = cache.find_or_compute("w2vv/primary/dog", out.data(), size, []() -> const float * { return nullptr; });
+		do_assert(res == ScoreCache::Lookup::Shared, "The second lookup SHOULD hit.");
+		do_assert(out == fresh(1.0F), "The hit SHOULD be equal to a fresh computation.");
+
+		do_assert(!cache.find("w2vv/primary/cat", out.data(), size), "Unknown key SHOULD miss.");
+	}
+
+	/*
+	 * #2 Half floats round-trip within the tolerance
+	 */
+	{
+		ScoreCache cache{ 1 << 20, true };
+		std::vector<float> computed{ fresh(2.0F) };
+		std::vector<float> out(size);
+
+		cache.store("clip/secondary/dog", computed.data(), size);
+		do_assert(cache.find("clip/secondary/dog", out.data(), size), "Stored key SHOULD hit.");
+		for (size_t i{ 0 }; i < size; ++i) {
+			do_assert(std::abs(out[i] - computed[i]) <= 1e-3F * std::max(1.0F, std::abs(computed[i])),
+			          "Half float round-trip is out of the tolerance.");
+		}
+		do_assert(cache.stats().mem_size == size * sizeof(uint16_t), "Half floats SHOULD be stored.");
+	}
+
+	/*
+	 * #3 Concurrent identical keys are computed once (single-flight)
+	 */
+	{
+		ScoreCache cache{ 1 << 20, false };
+		std::vector<float> computed{ fresh(3.0F) };
+		std::atomic<size_t> num_computed{ 0 };
+
+		constexpr size_t num_threads{ 8 };
+		std::vector<std::vector<float>> outs(num_threads, std::vector<float>(size));
+		std::vector<ScoreCache::Lookup> results(num_threads);
+		std::vector<std::thread> threads;
+		for (size_t t{ 0 }; t < num_threads; ++t) {
+			threads.emplace_back([&, t]() {
+				results[t] = cache.find_or_compute("w2vv/primary/park", outs[t].data(), size, [&]() {
+					++num_computed;
+					std::this_thread::sleep_for(std::chrono::milliseconds(50));
+					return computed.data();
+				});
+			});
+		}
+		for (auto &&th : threads) th.join();
+
+		do_assert_equals(num_computed.load(), 1_z, "The key SHOULD be computed once.");
+		for (size_t t{ 0 }; t < num_threads; ++t) {
+			if (results[t] == ScoreCache::Lookup::Computed) continue;
+
+			do_assert(results[t] == ScoreCache::Lookup::Shared, "The others SHOULD share the result.");
+			do_assert(outs[t] == computed, "The shared result SHOULD be equal to the computed one.");
+		}
+
+		auto stats{ cache.stats() };
+		do_assert_equals(stats.num_misses - stats.num_coalesced, 1_z, "Only one lookup SHOULD compute.");
+		do_assert_equals(stats.num_hits + stats.num_coalesced, num_threads - 1, "The others SHOULD hit or wait.");
+	}
+
+	SHLOG("\t Testing `ScoreCache` finished.");
+}
+
 void TESTER_Somhunter::TEST_rescore_filters(Somhunter &core) {
 	SHLOG("\t Testing `Somhunter::TEST_rescore` score filter...");
 
@@ -378,6 +515,8 @@ void TESTER_Somhunter::TEST_log_results(Somhunter &core) {
 	{
 		// <!> ACTION: RESET_ALL
 		core.reset_search_session();
+		// The result logs are written in the background
+		core._user_context._logger.flush();
 
 		json val{ RESET_ALL };
 		json data{ wrap_and_parse(actions) };
@@ -391,6 +530,7 @@ void TESTER_Somhunter::TEST_log_results(Somhunter &core) {
 
 		// <!> ACTION: SHOW_TOP_SCORED_DISPLAY
 		core.get_display(DisplayType::DTopN, 0, 0);
+		core._user_context._logger.flush();
 
 		std::cout << summary.str() << std::endl;
 		std::cout << actions.str() << std::endl;
@@ -398,6 +538,7 @@ void TESTER_Somhunter::TEST_log_results(Somhunter &core) {
 
 		// <!> ACTION: SHOW_TOP_SCORED_CONTEXT_DISPLAY
 		core.get_display(DisplayType::DTopNContext, 0, 0);
+		core._user_context._logger.flush();
 
 		std::cout << summary.str() << std::endl;
 		std::cout << actions.str() << std::endl;
@@ -405,6 +546,7 @@ void TESTER_Somhunter::TEST_log_results(Somhunter &core) {
 
 		// <!> ACTION: SHOW_SOM_DISPLAY
 		core.get_display(DisplayType::DSom, 0, 0);
+		core._user_context._logger.flush();
 	
 		std::cout << summary.str() << std::endl;
 		std::cout << actions.str() << std::endl;
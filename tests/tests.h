@@ -34,6 +34,7 @@ private:
 	static void TEST_bookmark_frames(Somhunter &core);
 	static void TEST_autocomplete_keywords(Somhunter &core);
 	static void TEST_rescore(Somhunter &core);
+	static void TEST_score_cache();
 	static void TEST_rescore_filters(Somhunter &core);
 	static void TEST_canvas_queries(Somhunter &core);
 